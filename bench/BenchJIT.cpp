@@ -0,0 +1,89 @@
+#include "BenchJIT.h"
+#include "CodeGen.h"
+#include "JIT.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+// The runtime functions the JIT binds the generated code to.
+static uint32_t Checksum;
+
+extern "C" void gsm_write(int V)
+{
+    Checksum = Checksum * 31 + (uint32_t)V;
+}
+
+extern "C" void gsm_write_buffered(int V)
+{
+    gsm_write(V);
+}
+
+extern "C" void gsm_flush()
+{
+}
+
+extern "C" int gsm_read(char *)
+{
+    return 0;
+}
+
+extern "C" void gsm_prof_dump(const unsigned long long *, int, const char *)
+{
+}
+
+uint32_t benchChecksum(const int *First, const int *Last)
+{
+    uint32_t Sum = 0;
+    for (; First != Last; ++First)
+        Sum = Sum * 31 + (uint32_t)*First;
+    return Sum;
+}
+
+std::unique_ptr<llvm::Module> compileBenchProgram(const std::string &Source, const BenchOptions &Opts,
+                                                  llvm::LLVMContext &Ctx)
+{
+    Lexer Lex(Source);
+    ASTContext Context;
+    Parser Parse(Lex, Context);
+    AST *Tree = Parse.parse();
+    Sema Semantic;
+    Sema::FoldStats Stats;
+    if (!Tree || Parse.hasError() || Semantic.semantic(Tree))
+        return nullptr;
+    if (Opts.Fold)
+        Semantic.fold(Tree, Stats);
+
+    CodeGen Gen(Opts.OptLevel);
+    if (!Opts.ProfileUse.empty() && Gen.setProfileUse(Opts.ProfileUse))
+        return nullptr;
+    std::unique_ptr<llvm::Module> M = Gen.generate(Tree, Ctx);
+    if (M && Opts.PrintIR)
+        M->print(llvm::outs(), nullptr);
+    return M;
+}
+
+bool runBenchProgram(const std::string &Source, const BenchOptions &Opts, BenchResult &Res)
+{
+    auto Ctx = std::make_unique<llvm::LLVMContext>();
+    std::unique_ptr<llvm::Module> M = compileBenchProgram(Source, Opts, *Ctx);
+    if (!M)
+        return true;
+    Res.Instructions = Res.Calls = 0;
+    for (llvm::BasicBlock &BB : *M->getFunction("main"))
+        for (llvm::Instruction &I : BB)
+        {
+            ++Res.Instructions;
+            Res.Calls += llvm::isa<llvm::CallInst>(I);
+        }
+
+    Checksum = 0;
+    JIT Engine;
+    int ExitCode;
+    if (Engine.run(std::move(M), std::move(Ctx), ExitCode))
+        return true;
+    Res.CompileTime = Engine.getCompileTime();
+    Res.ExecuteTime = Engine.getExecuteTime();
+    Res.Checksum = Checksum;
+    return false;
+}
@@ -0,0 +1,42 @@
+#ifndef BENCHJIT_H
+#define BENCHJIT_H
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Compiles GSM programs and runs them in the JIT for the benchmarks. The
+// runtime functions the generated code calls are defined in BenchJIT.cpp
+// instead of gsmrt: the written values only update a checksum, so the time
+// is spent in the program and not in printing its results.
+
+struct BenchResult
+{
+    double CompileTime;
+    double ExecuteTime;
+    unsigned Instructions; // in main after optimization
+    unsigned Calls;        // in main, more than one per loop if it was unrolled
+    uint32_t Checksum;     // of the values written by the program
+};
+
+struct BenchOptions
+{
+    unsigned OptLevel = 0;
+    bool Fold = true;       // run the constant folder of Sema
+    bool PrintIR = false;   // print the optimized module
+    std::string ProfileUse; // weight the branches with this profile, or empty
+};
+
+// Returns the checksum of a program that writes the values from First to Last.
+uint32_t benchChecksum(const int *First, const int *Last);
+
+// Compiles Source into an optimized module, or returns null if it has errors.
+std::unique_ptr<llvm::Module> compileBenchProgram(const std::string &Source, const BenchOptions &Opts,
+                                                  llvm::LLVMContext &Ctx);
+
+// Compiles Source and runs it. Returns true if it cannot be compiled.
+bool runBenchProgram(const std::string &Source, const BenchOptions &Opts, BenchResult &Res);
+
+#endif
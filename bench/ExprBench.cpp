@@ -0,0 +1,191 @@
+// Compares the traversal throughput of the flat expression encoding (Expr.h)
+// with the pointer-chained visitor tree it replaced, where every node was a
+// separate heap object reached through a virtual accept and a visit call.
+#include "Expr.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+static llvm::cl::opt<unsigned>
+    Leaves("leaves",
+           llvm::cl::desc("Number of literals in the benchmark expression"),
+           llvm::cl::init(1000000));
+
+static llvm::cl::opt<unsigned>
+    Iterations("iterations",
+               llvm::cl::desc("Number of traversals to time"),
+               llvm::cl::init(20));
+
+namespace
+{
+    // The layout of the old expression tree: one heap object per node with
+    // child pointers and double dispatch through a visitor.
+    class TreeVisitor;
+
+    class TreeNode
+    {
+    public:
+        virtual ~TreeNode() {}
+        virtual void accept(TreeVisitor &V) = 0;
+    };
+
+    class TreeFactor;
+    class TreeBinaryOp;
+
+    class TreeVisitor
+    {
+    public:
+        virtual void visit(TreeFactor &) = 0;
+        virtual void visit(TreeBinaryOp &) = 0;
+    };
+
+    class TreeFactor : public TreeNode
+    {
+    public:
+        int32_t Val;
+        TreeFactor(int32_t Val) : Val(Val) {}
+        virtual void accept(TreeVisitor &V) override { V.visit(*this); }
+    };
+
+    class TreeBinaryOp : public TreeNode
+    {
+    public:
+        Expr::ExprKind Op;
+        TreeNode *Left;
+        TreeNode *Right;
+        TreeBinaryOp(Expr::ExprKind Op, TreeNode *Left, TreeNode *Right) : Op(Op), Left(Left), Right(Right) {}
+        virtual void accept(TreeVisitor &V) override { V.visit(*this); }
+    };
+
+    // Wrapping arithmetic, so the benchmark has no undefined behavior.
+    uint32_t apply(Expr::ExprKind Op, uint32_t L, uint32_t R)
+    {
+        switch (Op)
+        {
+        case Expr::Plus:
+            return L + R;
+        case Expr::Minus:
+            return L - R;
+        default:
+            return L * R;
+        }
+    }
+
+    // Evaluates the tree the way ToIRVisitor used to walk it.
+    class TreeEvaluator : public TreeVisitor
+    {
+    public:
+        uint32_t V = 0;
+
+        virtual void visit(TreeFactor &Node) override { V = (uint32_t)Node.Val; }
+
+        virtual void visit(TreeBinaryOp &Node) override
+        {
+            Node.Left->accept(*this);
+            uint32_t L = V;
+            Node.Right->accept(*this);
+            V = apply(Node.Op, L, V);
+        }
+    };
+
+    // Evaluates the flat encoding with a single forward scan.
+    uint32_t evaluate(const ExprPool &Exprs, ExprId Root, std::vector<uint32_t> &Vals)
+    {
+        ExprId First = Exprs.first(Root);
+        Vals.resize(Root - First + 1);
+        for (ExprId I = First; I <= Root; ++I)
+        {
+            const Expr &Node = Exprs[I];
+            Vals[I - First] = Node.isLeaf() ? (uint32_t)Node.getValue()
+                                            : apply(Node.Kind, Vals[Node.LHS - First], Vals[Node.RHS - First]);
+        }
+        return Vals.back();
+    }
+
+    // Generates a random expression with N literals in the pool, operands
+    // first as the parser does.
+    ExprId generate(ExprPool &Exprs, unsigned N, std::mt19937 &Rand)
+    {
+        if (N == 1)
+            return Exprs.number((int32_t)(Rand() % 100));
+        unsigned LeftLeaves = 1 + Rand() % (N - 1);
+        ExprId L = generate(Exprs, LeftLeaves, Rand);
+        ExprId R = generate(Exprs, N - LeftLeaves, Rand);
+        static const Expr::ExprKind Ops[] = {Expr::Plus, Expr::Minus, Expr::Mul};
+        return Exprs.binary(Ops[Rand() % 3], L, R);
+    }
+
+    // Builds the equivalent pointer tree, one allocation per node.
+    TreeNode *buildTree(const ExprPool &Exprs, ExprId Id, std::vector<std::unique_ptr<TreeNode>> &Owner)
+    {
+        const Expr &Node = Exprs[Id];
+        TreeNode *Res;
+        if (Node.isLeaf())
+            Res = new TreeFactor(Node.getValue());
+        else
+        {
+            TreeNode *L = buildTree(Exprs, Node.LHS, Owner);
+            TreeNode *R = buildTree(Exprs, Node.RHS, Owner);
+            Res = new TreeBinaryOp(Node.Kind, L, R);
+        }
+        Owner.emplace_back(Res);
+        return Res;
+    }
+
+    double seconds(std::chrono::steady_clock::time_point Start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM expression traversal benchmark\n");
+
+    std::mt19937 Rand(42);
+    ExprPool Exprs;
+    ExprId Root = generate(Exprs, Leaves < 1 ? 1 : (unsigned)Leaves, Rand);
+    std::vector<std::unique_ptr<TreeNode>> Owner;
+    TreeNode *Tree = buildTree(Exprs, Root, Owner);
+    size_t Nodes = Exprs.size();
+
+    // Time the flat scan.
+    std::vector<uint32_t> Vals;
+    uint32_t FlatSum = 0;
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I)
+        FlatSum += evaluate(Exprs, Root, Vals);
+    double FlatTime = seconds(Start);
+
+    // Time the visitor over the pointer tree.
+    uint32_t TreeSum = 0;
+    Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I)
+    {
+        TreeEvaluator Eval;
+        Tree->accept(Eval);
+        TreeSum += Eval.V;
+    }
+    double TreeTime = seconds(Start);
+
+    if (FlatSum != TreeSum)
+    {
+        llvm::errs() << "Results differ: " << FlatSum << " != " << TreeSum << "\n";
+        return 1;
+    }
+
+    double Visited = (double)Nodes * Iterations;
+    llvm::outs() << "nodes: " << Nodes << ", iterations: " << Iterations << "\n";
+    llvm::outs() << llvm::format("flat:    %8.2f Mnodes/s (%zu bytes per node)\n",
+                                 Visited / FlatTime / 1e6, sizeof(Expr));
+    llvm::outs() << llvm::format("visitor: %8.2f Mnodes/s (%zu bytes per node)\n",
+                                 Visited / TreeTime / 1e6, sizeof(TreeBinaryOp));
+    llvm::outs() << llvm::format("speedup: %8.2fx\n", TreeTime / FlatTime);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Compiles if statements without folding and reports whether each one is
+// lowered to selects, which evaluate every arm and every condition, or to
+// branches. Then runs them in the JIT at -O0 and at -O3 and checks the
+// values they write. The programs whose conditions or arms may divide by
+// zero must keep their branches, otherwise the selected form traps. Some
+// programs are compiled with a profile, which keeps the branches only if one
+// arm takes at least 99% of the count.
+#include "BenchJIT.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+static llvm::cl::opt<bool>
+    PrintIR("print-ir",
+            llvm::cl::desc("Print the optimized module of each program and level"));
+
+namespace
+{
+    struct CheckProgram
+    {
+        const char *Name;
+        const char *Source;
+        bool Select;             // the if statement is lowered to selects
+        std::vector<int> Writes; // the values the program writes
+        std::vector<uint64_t> Profile; // arm counts to compile with, if any
+    };
+
+    // Writes the arm counts in the format of gsm_prof_dump. Returns true on
+    // error.
+    bool writeProfile(llvm::ArrayRef<uint64_t> Counts, llvm::SmallVectorImpl<char> &Path)
+    {
+        int FD;
+        if (llvm::sys::fs::createTemporaryFile("gsm-ifbench", "profile", FD, Path))
+            return true;
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << "gsm-profile\n" << Counts.size() << "\n";
+        for (uint64_t Count : Counts)
+            OS << Count << "\n";
+        return false;
+    }
+
+    // Tests if main of the unoptimized module contains a select.
+    bool hasSelect(const std::string &Source, BenchOptions Opts, bool &Select)
+    {
+        llvm::LLVMContext Ctx;
+        Opts.OptLevel = 0;
+        std::unique_ptr<llvm::Module> M = compileBenchProgram(Source, Opts, Ctx);
+        if (!M)
+            return true;
+        Select = false;
+        for (llvm::BasicBlock &BB : *M->getFunction("main"))
+            for (llvm::Instruction &I : BB)
+                Select |= llvm::isa<llvm::SelectInst>(I);
+        return false;
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM if statement checks\n");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // The first programs are variants of one whose elif divided by zero when
+    // it was evaluated unconditionally. a is 0 in all of them.
+    const CheckProgram Programs[] = {
+        {"safe elif", "int a, x; a = 0; loopc x < 1: begin x += 1; end "
+                      "if a == 0: begin x = 1; end elif 10 / 5 > a: begin x = 2; end else: begin x = 3; end",
+         true, {1, 1}},
+        {"elif divides", "int a, x; a = 0; loopc x < 1: begin x += 1; end "
+                         "if a == 0: begin x = 1; end elif 10 / a > 2: begin x = 2; end else: begin x = 3; end",
+         false, {1, 1}},
+        {"elif and", "int a, x; a = 0; loopc x < 1: begin x += 1; end "
+                     "if a == 0: begin x = 1; end elif a != 0 and 10 / a > 2: begin x = 2; end "
+                     "else: begin x = 3; end",
+         false, {1, 1}},
+        {"arm divides", "int a, x; a = 0; loopc x < 1: begin x += 1; end "
+                        "if a == 0: begin x = 1; end else: begin x = 10 / a; end",
+         false, {1, 1}},
+        {"arm modulo", "int a, x; a = 0; x = 7; "
+                       "if a != 0: begin x %= a; end else: begin x = 2; end",
+         false, {7, 2}},
+        // A short training run is below 100 counts.
+        {"small profile", "int a, x; a = 0; "
+                          "if a == 0: begin x = 1; end elif a > 5: begin x = 2; end else: begin x = 3; end",
+         true, {1}, {3, 2, 1}},
+        {"98% profile", "int a, x; a = 0; "
+                        "if a == 0: begin x = 1; end elif a > 5: begin x = 2; end else: begin x = 3; end",
+         true, {1}, {98, 1, 1}},
+        {"99% profile", "int a, x; a = 0; "
+                        "if a == 0: begin x = 1; end elif a > 5: begin x = 2; end else: begin x = 3; end",
+         false, {1}, {99, 0, 1}},
+    };
+
+    llvm::outs() << "program        lowering  -O0  -O3\n";
+    bool Failed = false;
+    for (const CheckProgram &P : Programs)
+    {
+        BenchOptions Opts;
+        Opts.Fold = false;
+        Opts.PrintIR = PrintIR;
+        llvm::SmallString<128> ProfilePath;
+        if (!P.Profile.empty())
+        {
+            if (writeProfile(P.Profile, ProfilePath))
+            {
+                llvm::errs() << "Cannot write the profile of the " << P.Name << " program\n";
+                return 1;
+            }
+            Opts.ProfileUse = std::string(ProfilePath.str());
+        }
+
+        bool Select;
+        if (hasSelect(P.Source, Opts, Select))
+        {
+            llvm::errs() << "Cannot compile the " << P.Name << " program\n";
+            return 1;
+        }
+        uint32_t Expected = benchChecksum(P.Writes.data(), P.Writes.data() + P.Writes.size());
+        const char *Checks[2];
+        for (unsigned Level : {0, 3})
+        {
+            Opts.OptLevel = Level;
+            BenchResult Res;
+            if (runBenchProgram(P.Source, Opts, Res))
+            {
+                llvm::errs() << "Cannot compile the " << P.Name << " program\n";
+                return 1;
+            }
+            bool Ok = Res.Checksum == Expected;
+            Checks[Level != 0] = Ok ? "ok" : "FAILED";
+            Failed |= !Ok;
+        }
+        if (!ProfilePath.empty())
+            llvm::sys::fs::remove(ProfilePath);
+        const char *Lowering = Select ? "select" : "branch";
+        if (Select != P.Select)
+        {
+            Lowering = Select ? "select!" : "branch!";
+            Failed = true;
+        }
+        llvm::outs() << llvm::format("%-14s %-8s  %-3s  %s\n", P.Name, Lowering, Checks[0], Checks[1]);
+    }
+    return Failed;
+}
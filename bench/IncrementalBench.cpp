@@ -0,0 +1,182 @@
+// Measures the edit-to-IR latency of a Session: a generated program of
+// -statements lines is compiled once, then single-line edits are applied to
+// it one after another and the time each update takes until the module is
+// up to date again is reported. With -check the module left by the edits is
+// compared with the one of a fresh session on the final text.
+#include "Optimizer.h"
+#include "Session.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static llvm::cl::opt<unsigned>
+    Statements("statements",
+               llvm::cl::desc("Number of statements of the generated program"),
+               llvm::cl::init(100000));
+
+static llvm::cl::opt<unsigned>
+    Edits("edits",
+          llvm::cl::desc("Number of single-line edits to time"),
+          llvm::cl::init(400));
+
+static llvm::cl::opt<bool>
+    Check("check",
+          llvm::cl::desc("Compare the incrementally updated module with a fresh build"));
+
+namespace
+{
+    // Identifiers consist of letters only, so variable K is named by its
+    // digits in base 26.
+    std::string getVar(size_t K)
+    {
+        std::string Name = "v";
+        do
+            Name += char('a' + K % 26);
+        while (K /= 26);
+        return Name;
+    }
+
+    // Every tenth line declares a variable, the others assign to variables
+    // declared further up.
+    std::string makeAssign(size_t NumVars, std::mt19937 &Rand)
+    {
+        auto Var = [&]() { return getVar(Rand() % NumVars); };
+        return Var() + " = " + Var() + " + " + std::to_string(Rand() % 100) + " * " + Var() + ";";
+    }
+
+    std::string makeLine(size_t Line, std::mt19937 &Rand)
+    {
+        if (Line % 10 == 0)
+            return "int " + getVar(Line / 10) + " = " + std::to_string(Rand() % 100) + ";";
+        return makeAssign((Line + 9) / 10, Rand);
+    }
+
+    std::string join(const std::vector<std::string> &Lines)
+    {
+        std::string Text;
+        for (const std::string &L : Lines)
+            (Text += L) += '\n';
+        return Text;
+    }
+
+    double milliseconds(std::chrono::steady_clock::time_point Start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    // Lists the calls of main after optimizing a copy of the module. The
+    // runtime functions are renamed when they are declared again, so only
+    // the arguments are compared.
+    std::vector<std::string> getCalls(llvm::Module &M)
+    {
+        std::unique_ptr<llvm::Module> Copy = llvm::CloneModule(M);
+        Optimizer(nullptr, 2).optimize(*Copy);
+        std::vector<std::string> Calls;
+        for (llvm::BasicBlock &BB : *Copy->getFunction("main"))
+            for (llvm::Instruction &I : BB)
+                if (auto *Call = llvm::dyn_cast<llvm::CallInst>(&I))
+                {
+                    std::string Arg;
+                    llvm::raw_string_ostream OS(Arg);
+                    Call->getArgOperand(0)->printAsOperand(OS, false);
+                    Calls.push_back(OS.str());
+                }
+        return Calls;
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM incremental compilation benchmark\n");
+
+    std::mt19937 Rand(42);
+    std::vector<std::string> Lines;
+    for (size_t I = 0; I != Statements; ++I)
+        Lines.push_back(makeLine(I, Rand));
+
+    Session S;
+    std::string Text = join(Lines);
+    auto Start = std::chrono::steady_clock::now();
+    if (S.update(Text))
+        return 1;
+    double FullTime = milliseconds(Start);
+
+    // The edits cycle through: changing an assignment, changing the initial
+    // value of a declaration, which checks all its users again, inserting a
+    // line and removing it again.
+    std::vector<double> Times;
+    size_t Inserted = 0;
+    unsigned Checked = 0, Generated = 0;
+    for (unsigned E = 0; E != Edits; ++E)
+    {
+        switch (E % 4)
+        {
+        case 0:
+        {
+            size_t Line = 1 + Rand() % (Lines.size() - 1);
+            if (Line % 10 == 0)
+                ++Line;
+            Lines[Line] = makeLine(Line, Rand);
+            break;
+        }
+        case 1:
+        {
+            size_t Line = 10 * (Rand() % ((Lines.size() + 9) / 10));
+            Lines[Line] = makeLine(Line, Rand);
+            break;
+        }
+        case 2:
+            Inserted = 1 + Rand() % (Lines.size() - 1);
+            Lines.insert(Lines.begin() + Inserted, makeAssign((Inserted + 9) / 10, Rand));
+            break;
+        case 3:
+            Lines.erase(Lines.begin() + Inserted);
+            break;
+        }
+        Text = join(Lines);
+        Start = std::chrono::steady_clock::now();
+        if (S.update(Text))
+            return 1;
+        Times.push_back(milliseconds(Start));
+        Checked += S.getStats().Checked;
+        Generated += S.getStats().Generated;
+    }
+
+    std::sort(Times.begin(), Times.end());
+    double Sum = 0;
+    for (double T : Times)
+        Sum += T;
+    llvm::outs() << llvm::format("%zu statements, %zu bytes\n", S.getNumStatements(), Text.size());
+    llvm::outs() << llvm::format("full build:  %9.3f ms\n", FullTime);
+    if (!Times.empty())
+    {
+        llvm::outs() << llvm::format("edit to IR:  %9.3f ms mean, %.3f ms p50, %.3f ms max over %u edits\n",
+                                     Sum / Times.size(), Times[Times.size() / 2], Times.back(), unsigned(Edits));
+        llvm::outs() << llvm::format("per edit:    %9.1f statements checked, %.1f generated\n",
+                                     double(Checked) / Edits, double(Generated) / Edits);
+        llvm::outs() << llvm::format("speedup:     %9.1fx\n", FullTime / (Sum / Times.size()));
+    }
+
+    if (Check)
+    {
+        Session Fresh;
+        if (Fresh.update(Text))
+            return 1;
+        if (getCalls(*S.getModule()) != getCalls(*Fresh.getModule()))
+        {
+            llvm::errs() << "The incrementally updated module differs from a fresh build\n";
+            return 1;
+        }
+        llvm::outs() << "check: the incrementally updated module matches a fresh build\n";
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+// Measures the throughput of Lexer::next in tokens per second on a large
+// input, either a given file or a generated GSM program. With -verify it
+// instead checks that every scanning implementation supported by the CPU
+// produces the same tokens as the scalar one.
+#include "Lexer.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <random>
+#include <string>
+
+static llvm::cl::opt<std::string>
+    InputFile(llvm::cl::Positional,
+              llvm::cl::desc("[input file]"),
+              llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned>
+    SizeMB("size",
+           llvm::cl::desc("Size of the generated input in MB"),
+           llvm::cl::init(64));
+
+static llvm::cl::opt<unsigned>
+    Iterations("iterations",
+               llvm::cl::desc("Number of passes over the input"),
+               llvm::cl::init(5));
+
+static llvm::cl::opt<unsigned>
+    Indent("indent",
+           llvm::cl::desc("Extra spaces before each statement of the generated input"),
+           llvm::cl::init(0));
+
+static llvm::cl::opt<Lexer::ScanKind>
+    Scan("scan",
+         llvm::cl::desc("Scanning implementation of the lexer"),
+         llvm::cl::values(clEnumValN(Lexer::Scalar, "scalar", "One character at a time"),
+                          clEnumValN(Lexer::SSE2, "sse2", "16 characters at a time"),
+                          clEnumValN(Lexer::AVX2, "avx2", "32 characters at a time")),
+         llvm::cl::init(Lexer::getBestScanKind()));
+
+static llvm::cl::opt<bool>
+    Batch("batch",
+          llvm::cl::desc("Lex into a TokenBuffer with Lexer::tokenizeAll"));
+
+static llvm::cl::opt<bool>
+    Verify("verify",
+           llvm::cl::desc("Compare the tokens of all scanning implementations"));
+
+namespace
+{
+    // Generates statements using every kind of token of the language.
+    std::string generate(size_t Size)
+    {
+        static const char *Names[] = {"a", "count", "x", "total", "idx", "value", "n", "sum"};
+        std::mt19937 Rand(42);
+        std::string Src;
+        Src.reserve(Size + 256);
+        unsigned Stmt = 0;
+        while (Src.size() < Size)
+        {
+            Src.append(Indent, ' ');
+            const char *A = Names[Rand() % 8];
+            const char *B = Names[Rand() % 8];
+            std::string N = std::to_string(Rand() % 100000);
+            switch (Stmt++ % 4)
+            {
+            case 0:
+                Src += "int " + std::string(A) + ", " + B + " = " + N + " * (" + A + " + 7), 3;\n";
+                break;
+            case 1:
+                Src += std::string(A) + " = " + B + " ^ 2 % " + N + " - " + A + " / 4;\n";
+                break;
+            case 2:
+                Src += "if " + std::string(A) + " > " + N + " and " + B + " < 10:\n  begin\n    " + A +
+                       " = " + B + ";\n  end\nelse:\n  begin\n    " + B + " = " + N + ";\n  end\n";
+                break;
+            default:
+                Src += "loopc " + std::string(A) + " < " + N + " or True:\n\tbegin\n\t\t" + A + " = " + A +
+                       " + 1;\n\tend\n";
+                break;
+            }
+        }
+        return Src;
+    }
+
+    // Random bytes drawn mostly from the character classes with runs, so the
+    // runs start and end at every offset of a vector.
+    std::string generateRandom(size_t Size, std::mt19937 &Rand)
+    {
+        static const char Chars[] = " \t\n\r\v\fazAZgmQ0959+-*/%^=<>!(),;:_@\x80\xff";
+        std::string Src;
+        while (Src.size() < Size)
+            Src.append(Rand() % 40 + 1, Chars[Rand() % (sizeof(Chars) - 1)]);
+        Src.resize(Size);
+        return Src;
+    }
+
+    // Lexes Input with Kind and with the scalar loops and reports the first
+    // token that differs.
+    bool compare(llvm::StringRef Input, Lexer::ScanKind Kind)
+    {
+        Lexer Expected(Input, Lexer::Scalar), Actual(Input, Kind);
+        Token E, A;
+        do
+        {
+            Expected.next(E);
+            Actual.next(A);
+            if (E.getKind() != A.getKind() || E.getText().data() != A.getText().data() ||
+                E.getText().size() != A.getText().size())
+            {
+                llvm::errs() << "scan kind " << Kind << " differs at offset "
+                             << E.getText().data() - Input.data() << "\n";
+                return false;
+            }
+        } while (!E.is(Token::eoi));
+        return true;
+    }
+
+    bool verify(llvm::StringRef Input)
+    {
+        std::mt19937 Rand(7);
+        for (Lexer::ScanKind Kind : {Lexer::SSE2, Lexer::AVX2})
+        {
+            if (!Lexer::isSupported(Kind))
+                continue;
+            if (!compare(Input, Kind))
+                return false;
+            for (size_t Size = 0; Size < 4096; ++Size)
+            {
+                // lex a copy so the input ends exactly at the end of the allocation
+                std::string Random = generateRandom(Size, Rand);
+                std::unique_ptr<char[]> Copy(new char[Size]);
+                std::copy(Random.begin(), Random.end(), Copy.get());
+                if (!compare(llvm::StringRef(Copy.get(), Size), Kind))
+                    return false;
+            }
+            llvm::outs() << "scan kind " << Kind << ": ok\n";
+        }
+        return true;
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM lexer benchmark\n");
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (InputFile.empty())
+        Buffer = llvm::MemoryBuffer::getMemBufferCopy(generate((size_t)SizeMB << 20), "<generated>");
+    else
+    {
+        auto FileOrErr = llvm::MemoryBuffer::getFileOrSTDIN(InputFile, false, false);
+        if (std::error_code EC = FileOrErr.getError())
+        {
+            llvm::errs() << "Cannot read " << InputFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*FileOrErr);
+    }
+
+    if (Verify)
+        return verify(Buffer->getBuffer()) ? 0 : 1;
+
+    if (!Lexer::isSupported(Scan))
+    {
+        llvm::errs() << "The selected scanning implementation is not supported by this CPU\n";
+        return 1;
+    }
+
+    uint64_t Tokens = 0;
+    TokenBuffer Buf; // reused, like a driver lexing one file after another
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I)
+    {
+        Lexer Lex(*Buffer, Scan);
+        if (Batch)
+        {
+            Lex.tokenizeAll(Buf);
+            Tokens += Buf.size();
+            continue;
+        }
+        Token Tok;
+        do
+        {
+            Lex.next(Tok);
+            ++Tokens;
+        } while (!Tok.is(Token::eoi));
+    }
+    double Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    double Bytes = (double)Buffer->getBufferSize() * Iterations;
+    llvm::outs() << "input: " << Buffer->getBufferSize() << " bytes, "
+                 << Tokens / Iterations << " tokens\n";
+    llvm::outs() << llvm::format("%.2f Mtokens/s, %.1f MB/s\n",
+                                 Tokens / Time / 1e6, Bytes / Time / (1 << 20));
+    return 0;
+}
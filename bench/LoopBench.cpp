@@ -0,0 +1,65 @@
+// Runs a summation loop written in GSM in the JIT at -O0 and at -O3 and
+// reports the execution time of both. The runtime is replaced by a checksum,
+// so the time is spent in the loop and not in printing its results.
+#include "BenchJIT.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+static llvm::cl::opt<unsigned>
+    Iterations("iterations",
+               llvm::cl::desc("Number of iterations of the GSM loop"),
+               llvm::cl::init(100000000));
+
+static llvm::cl::opt<bool>
+    PrintIR("print-ir",
+            llvm::cl::desc("Print the optimized module of each level"));
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM loop benchmark\n");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // Sums up the first n multiples of three; every assignment reports the
+    // partial sum to the runtime.
+    std::string Source = "int n = " + std::to_string(Iterations) + ";\n"
+                         "int s = 0;\n"
+                         "loopc s < 3 * n :\n"
+                         "begin\n"
+                         "    s += 3;\n"
+                         "end\n";
+
+    auto Run = [&](unsigned OptLevel, BenchResult &Res)
+    {
+        BenchOptions Opts;
+        Opts.OptLevel = OptLevel;
+        Opts.PrintIR = PrintIR;
+        return runBenchProgram(Source, Opts, Res);
+    };
+    BenchResult O0, O3;
+    if (Run(0, O0) || Run(3, O3))
+    {
+        llvm::errs() << "Cannot compile the benchmark program\n";
+        return 1;
+    }
+    if (O0.Checksum != O3.Checksum)
+    {
+        llvm::errs() << "The results of -O0 and -O3 differ\n";
+        return 1;
+    }
+
+    auto Print = [](const char *Name, const BenchResult &Res)
+    {
+        llvm::outs() << llvm::format("%s: %9.3f ms execute, %7.3f ms compile, %3u instructions, %u runtime calls\n",
+                                     Name, Res.ExecuteTime, Res.CompileTime, Res.Instructions, Res.Calls);
+    };
+    Print("-O0", O0);
+    Print("-O3", O3);
+    llvm::outs() << llvm::format("speedup: %.2fx\n", O0.ExecuteTime / O3.ExecuteTime);
+    return 0;
+}
@@ -0,0 +1,285 @@
+// Parses single expressions of a million operands and more: long chains of
+// one operator class, a random mix of all operators, and a deeply nested
+// parenthesized expression. Reports the lex and parse time per operand and
+// checks the associativity of the tree by evaluating it against the value
+// the generator computed from the left-to-right semantics. Every expression
+// is also lexed up front into a TokenBuffer and parsed from there, which
+// must build the same nodes as parsing from the lexer.
+#include "Parser.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+static llvm::cl::opt<unsigned>
+    Operands("operands",
+             llvm::cl::desc("Number of operands of each benchmark expression"),
+             llvm::cl::init(1000000));
+
+static llvm::cl::opt<unsigned>
+    Iterations("iterations",
+               llvm::cl::desc("Number of parses to time, the fastest one is reported"),
+               llvm::cl::init(5));
+
+static llvm::cl::opt<unsigned>
+    Seed("seed",
+         llvm::cl::desc("Seed of the expression generator"),
+         llvm::cl::init(42));
+
+namespace
+{
+    // Computes L Kind R like the generated code, with 32-bit wrap-around.
+    // The divisors of the generated expressions are never 0.
+    int32_t evaluate(Expr::ExprKind Kind, int32_t L, int32_t R)
+    {
+        uint32_t UL = L, UR = R;
+        switch (Kind)
+        {
+        case Expr::Plus:
+            return (int32_t)(UL + UR);
+        case Expr::Minus:
+            return (int32_t)(UL - UR);
+        case Expr::Mul:
+            return (int32_t)(UL * UR);
+        case Expr::Div:
+            return L == INT32_MIN && R == -1 ? L : L / R;
+        case Expr::Mod:
+            return L == INT32_MIN && R == -1 ? 0 : L % R;
+        case Expr::Power:
+        {
+            uint32_t Result = 1;
+            for (; UR; UR >>= 1, UL *= UL)
+                if (UR & 1)
+                    Result *= UL;
+            return (int32_t)Result;
+        }
+        case Expr::LessThan:
+            return L < R;
+        case Expr::GreaterThan:
+            return L > R;
+        case Expr::LessThanEqual:
+            return L <= R;
+        case Expr::GreaterThanEqual:
+            return L >= R;
+        case Expr::Equal:
+            return L == R;
+        case Expr::NotEqual:
+            return L != R;
+        case Expr::And:
+            return L != 0 && R != 0;
+        case Expr::Or:
+            return L != 0 || R != 0;
+        default:
+            return 0;
+        }
+    }
+
+    // Evaluates the expression rooted at Root; the pool holds it in
+    // post-order, so one forward scan suffices.
+    int32_t evaluate(const ExprPool &Exprs, ExprId Root)
+    {
+        ExprId First = Exprs.first(Root);
+        std::vector<int32_t> Vals(Root - First + 1);
+        for (ExprId I = First; I <= Root; ++I)
+        {
+            const Expr &Node = Exprs[I];
+            Vals[I - First] = Node.isLeaf() ? Node.getValue()
+                                            : evaluate(Node.Kind, Vals[Node.LHS - First], Vals[Node.RHS - First]);
+        }
+        return Vals.back();
+    }
+
+    struct Shape
+    {
+        const char *Name;
+        std::string Source;
+        int32_t Expected;
+        bool Checked; // Expected is known
+    };
+
+    struct Op
+    {
+        const char *Text;
+        Expr::ExprKind Kind;
+    };
+
+    // Builds a chain "d op d op d ..." of literals from Low to High with
+    // operators drawn from Ops. The value is computed from left to right, or
+    // from right to left for a right associative chain.
+    Shape chain(const char *Name, llvm::ArrayRef<Op> Ops, bool RightAssoc, int32_t Low, int32_t High,
+                std::mt19937 &Rand)
+    {
+        Shape S{Name, "int x = ", 0, true};
+        std::vector<int32_t> Values;
+        std::vector<Expr::ExprKind> Kinds;
+        for (unsigned I = 0; I != Operands; ++I)
+        {
+            if (I)
+            {
+                const Op &O = Ops[Rand() % Ops.size()];
+                S.Source += O.Text;
+                Kinds.push_back(O.Kind);
+            }
+            int32_t Value = Low + Rand() % (High - Low + 1);
+            S.Source += char('0' + Value);
+            Values.push_back(Value);
+        }
+        S.Source += ";\n";
+        if (RightAssoc)
+        {
+            S.Expected = Values.back();
+            for (size_t I = Kinds.size(); I-- != 0;)
+                S.Expected = evaluate(Kinds[I], Values[I], S.Expected);
+        }
+        else
+        {
+            S.Expected = Values.front();
+            for (size_t I = 0; I != Kinds.size(); ++I)
+                S.Expected = evaluate(Kinds[I], S.Expected, Values[I + 1]);
+        }
+        return S;
+    }
+
+    // Builds "(1 + (1 + (1 + ... 1)))", one parenthesis per operand.
+    Shape nested()
+    {
+        Shape S{"nested", "int x = ", (int32_t)Operands, true};
+        for (unsigned I = 1; I < Operands; ++I)
+            S.Source += "(1 + ";
+        S.Source += '1';
+        S.Source.append(Operands - 1, ')');
+        S.Source += ";\n";
+        return S;
+    }
+
+    // Parses Source, either from the lexer or from the tokens it lexed up
+    // front, and stores the time in milliseconds. Returns true if it does
+    // not parse.
+    bool parse(const std::string &Source, bool Batch, ASTContext &Context, double &Time)
+    {
+        Lexer Lex(Source);
+        auto Start = std::chrono::steady_clock::now();
+        AST *Tree;
+        bool Error;
+        if (Batch)
+        {
+            TokenBuffer Tokens;
+            if (Lex.tokenizeAll(Tokens))
+                return true;
+            Parser Parse(Tokens, Context);
+            Tree = Parse.parse();
+            Error = Parse.hasError();
+        }
+        else
+        {
+            Parser Parse(Lex, Context);
+            Tree = Parse.parse();
+            Error = Parse.hasError();
+        }
+        Time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+        return !Tree || Error;
+    }
+
+    // Tests if two pools hold the same nodes.
+    bool sameExprs(const ExprPool &A, const ExprPool &B)
+    {
+        if (A.size() != B.size())
+            return false;
+        for (ExprId I = 0; I != A.size(); ++I)
+            if (A[I].Kind != B[I].Kind || A[I].LHS != B[I].LHS || A[I].RHS != B[I].RHS)
+                return false;
+        return true;
+    }
+
+    // Builds a random mix of all operators and parentheses. The value is not
+    // checked, a parenthesized divisor may be 0.
+    Shape mixed(std::mt19937 &Rand)
+    {
+        static const char *const Ops[] = {" + ", " - ", " * ", " / ", " % ", " ^ ", " < ", " > ", " <= ",
+                                          " >= ", " == ", " != ", " and ", " or "};
+        Shape S{"mixed", "int x = ", 0, false};
+        unsigned Open = 0;
+        for (unsigned I = 0; I != Operands; ++I)
+        {
+            if (I)
+                S.Source += Ops[Rand() % (sizeof(Ops) / sizeof(Ops[0]))];
+            if (Rand() % 8 == 0)
+            {
+                S.Source += '(';
+                ++Open;
+            }
+            S.Source += char('1' + Rand() % 9);
+            if (Open && Rand() % 8 == 0)
+            {
+                S.Source += ')';
+                --Open;
+            }
+        }
+        S.Source.append(Open, ')');
+        S.Source += ";\n";
+        return S;
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM expression parser benchmark\n");
+    if (Operands < 1)
+    {
+        llvm::errs() << "-operands must be positive\n";
+        return 1;
+    }
+
+    std::mt19937 Rand(Seed);
+    std::vector<Shape> Shapes;
+    Shapes.push_back(chain("additive", {{" + ", Expr::Plus}, {" - ", Expr::Minus}}, false, 1, 9, Rand));
+    Shapes.push_back(chain("multiplicative", {{" * ", Expr::Mul}, {" / ", Expr::Div}, {" % ", Expr::Mod}}, false, 1, 9, Rand));
+    Shapes.push_back(chain("power", {{" ^ ", Expr::Power}}, true, 0, 3, Rand));
+    Shapes.push_back(chain("logical", {{" and ", Expr::And}, {" or ", Expr::Or}}, false, 0, 1, Rand));
+    Shapes.push_back(nested());
+    Shapes.push_back(mixed(Rand));
+
+    llvm::outs() << "shape             MB   parse ms  ns/operand   batch ms  tokens  check\n";
+    bool Failed = false;
+    for (const Shape &S : Shapes)
+    {
+        double Best = 0, BestBatch = 0;
+        int32_t Value = 0;
+        bool Same = true;
+        for (unsigned I = 0; I != std::max(1u, (unsigned)Iterations); ++I)
+        {
+            ASTContext Context, BatchContext;
+            double Time, BatchTime;
+            if (parse(S.Source, false, Context, Time) || parse(S.Source, true, BatchContext, BatchTime))
+            {
+                llvm::errs() << "The " << S.Name << " expression does not parse\n";
+                return 1;
+            }
+            if (I == 0 || Time < Best)
+                Best = Time;
+            if (I == 0 || BatchTime < BestBatch)
+                BestBatch = BatchTime;
+            const ExprPool &Exprs = Context.getExprs();
+            if (S.Checked)
+                Value = evaluate(Exprs, (ExprId)(Exprs.size() - 1));
+            Same &= sameExprs(Exprs, BatchContext.getExprs());
+        }
+
+        const char *Check = "-";
+        if (S.Checked)
+        {
+            Check = Value == S.Expected ? "ok" : "FAILED";
+            Failed |= Value != S.Expected;
+        }
+        Failed |= !Same;
+        llvm::outs() << llvm::format("%-14s %5.1f %10.2f %11.1f %10.2f  %-6s  %s\n", S.Name,
+                                     S.Source.size() / 1048576.0, Best, Best * 1e6 / Operands, BestBatch,
+                                     Same ? "same" : "DIFFER", Check);
+    }
+    return Failed;
+}
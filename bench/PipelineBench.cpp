@@ -0,0 +1,344 @@
+// Generates GSM programs from the productions of grammer.txt and runs the
+// whole pipeline, Lexer -> Parser -> Sema -> CodeGen, on programs of growing
+// size. For every size the time of each phase per statement is reported, so a
+// phase that stops scaling linearly or gets slower shows up in its column.
+#include "CodeGen.h"
+#include "Parser.h"
+#include "PhaseReport.h"
+#include "Sema.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+#include <string>
+
+static llvm::cl::list<unsigned>
+    Sizes("sizes",
+          llvm::cl::desc("Numbers of top-level statements of the generated programs "
+                         "(default: 1000,10000,100000,1000000)"),
+          llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<unsigned>
+    Identifiers("identifiers",
+                llvm::cl::desc("Number of variables declared by a program, at most one per statement"),
+                llvm::cl::init(1000));
+
+static llvm::cl::opt<unsigned>
+    Depth("depth",
+          llvm::cl::desc("Depth of the expression trees"),
+          llvm::cl::init(3));
+
+static llvm::cl::opt<unsigned>
+    IfPercent("if-percent",
+              llvm::cl::desc("Percentage of the statements that are if statements"),
+              llvm::cl::init(10));
+
+static llvm::cl::opt<unsigned>
+    LoopPercent("loop-percent",
+                llvm::cl::desc("Percentage of the statements that are loopc statements"),
+                llvm::cl::init(5));
+
+static llvm::cl::opt<unsigned>
+    Elifs("elifs",
+          llvm::cl::desc("Number of elif parts of an if statement"),
+          llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned>
+    BodySize("body",
+             llvm::cl::desc("Number of assignments in the blocks of if and loopc statements"),
+             llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned>
+    Seed("seed",
+         llvm::cl::desc("Seed of the program generator"),
+         llvm::cl::init(42));
+
+static llvm::cl::opt<unsigned>
+    OptLevel("opt",
+             llvm::cl::desc("Optimization level of the optimize phase"),
+             llvm::cl::init(0));
+
+static llvm::cl::opt<bool>
+    EmitObj("emit-obj",
+            llvm::cl::desc("Also generate an object file, which is discarded"));
+
+static llvm::cl::opt<bool>
+    JSON("json",
+         llvm::cl::desc("Print the phase report of every size as JSON instead of the table"));
+
+static llvm::cl::opt<bool>
+    PrintProgram("print-program",
+                 llvm::cl::desc("Print the generated program of the first size and exit"));
+
+namespace
+{
+    // Generates a program top-down from the productions of grammer.txt. The
+    // blocks of if and loopc statements only hold assignments, so the
+    // statements do not nest. Identifiers consist of letters only and every
+    // variable is declared before it is used. Divisors and exponents are
+    // small literals, so folding never finds a division by zero.
+    class Generator
+    {
+        std::mt19937 Rand;
+        std::string Out;
+        size_t Declared = 0;
+
+        unsigned pick(unsigned N) { return Rand() % N; }
+
+        static std::string getVar(size_t K)
+        {
+            std::string Name = "v";
+            do
+                Name += char('a' + K % 26);
+            while (K /= 26);
+            return Name;
+        }
+
+        // Factor -> id | Num | (Expr)
+        void factor(unsigned D)
+        {
+            if (D == 0 || pick(4) == 0)
+            {
+                if (Declared && pick(3) != 0)
+                    Out += getVar(pick(Declared));
+                else
+                    Out += std::to_string(pick(100));
+                return;
+            }
+            Out += '(';
+            expr(D - 1);
+            Out += ')';
+        }
+
+        // Expr -> Expr or Term | Expr and Term | Term, and so on down to
+        // Factor, picking one operator per level of the tree.
+        void expr(unsigned D)
+        {
+            if (D == 0)
+            {
+                factor(0);
+                return;
+            }
+            static const char *const Ops[] = {" + ", " - ", " * ", " / ", " % ", " ^ ", " < ", " > ",
+                                              " <= ", " >= ", " == ", " != ", " and ", " or "};
+            const char *Op = Ops[pick(sizeof(Ops) / sizeof(Ops[0]))];
+            factor(D - 1);
+            Out += Op;
+            if (Op[1] == '/' || Op[1] == '%')
+                Out += std::to_string(1 + pick(9));
+            else if (Op[1] == '^')
+                Out += std::to_string(pick(5));
+            else
+                factor(D - 1);
+        }
+
+        // Assignment -> Id Attr Expr;
+        void assignment()
+        {
+            static const char *const Attrs[] = {" = ", " += ", " -= ", " *= ", " /= ", " %= "};
+            unsigned Attr = pick(6);
+            Out += getVar(pick(Declared));
+            Out += Attrs[Attr];
+            if (Attr >= 4)
+                Out += std::to_string(1 + pick(9));
+            else
+                expr(Depth);
+            Out += ";\n";
+        }
+
+        void block()
+        {
+            Out += "begin\n";
+            for (unsigned I = 0; I != std::max(1u, (unsigned)BodySize); ++I)
+            {
+                Out += "    ";
+                assignment();
+            }
+            Out += "end\n";
+        }
+
+        // Variable -> int Id = Expr; | int Ids;
+        void variable(size_t Count)
+        {
+            Out += "int ";
+            if (Count == 1)
+            {
+                std::string Name = getVar(Declared);
+                Out += Name;
+                Out += " = ";
+                expr(Depth);
+                ++Declared;
+            }
+            else
+                for (size_t I = 0; I != Count; ++I)
+                {
+                    if (I)
+                        Out += ", ";
+                    Out += getVar(Declared++);
+                }
+            Out += ";\n";
+        }
+
+        // Con -> if Expr : begin SPrime end Conti
+        void condition()
+        {
+            Out += "if ";
+            expr(Depth);
+            Out += " :\n";
+            block();
+            for (unsigned I = 0; I != Elifs; ++I)
+            {
+                Out += "elif ";
+                expr(Depth);
+                Out += " :\n";
+                block();
+            }
+            Out += "else :\n";
+            block();
+        }
+
+        // Loop -> loopc Expr : begin SPrime end
+        void loop()
+        {
+            Out += "loopc ";
+            expr(Depth);
+            Out += " :\n";
+            block();
+        }
+
+    public:
+        Generator(unsigned Seed) : Rand(Seed) {}
+
+        // S -> Variable S | Con S | Loop S | ..., with the declarations of
+        // the identifiers spread evenly over the statements.
+        std::string generate(size_t Statements)
+        {
+            Out.clear();
+            Declared = 0;
+            size_t NumIds = std::max<size_t>(1, Identifiers);
+            for (size_t I = 0; I != Statements; ++I)
+            {
+                size_t Due = (I + 1) * NumIds / Statements;
+                if (Declared < Due || Declared == 0)
+                {
+                    variable(std::max<size_t>(1, Due - Declared));
+                    continue;
+                }
+                unsigned Kind = pick(100);
+                if (Kind < IfPercent)
+                    condition();
+                else if (Kind < IfPercent + LoopPercent)
+                    loop();
+                else
+                    assignment();
+            }
+            return std::move(Out);
+        }
+    };
+
+    // Runs the pipeline on Source, timing each phase into Report. Returns
+    // true if the program does not compile.
+    bool compile(const std::string &Source, PhaseReport &Report)
+    {
+        // Lex up front like gsm, so the parser does not lex again.
+        Lexer Lex(Source);
+        TokenBuffer Tokens;
+        {
+            PhaseReport::Region Time(&Report, "lex");
+            if (Lex.tokenizeAll(Tokens))
+                return true;
+        }
+        Report.count("lex", "tokens", Tokens.size());
+
+        ASTContext Context;
+        Parser Parse(Tokens, Context);
+        AST *Tree;
+        {
+            PhaseReport::Region Time(&Report, "parse");
+            Tree = Parse.parse();
+        }
+        if (!Tree || Parse.hasError())
+            return true;
+        Report.count("parse", "ast_bytes", Context.getBytesAllocated() + Context.getExprs().getBytesAllocated());
+
+        Sema Semantic;
+        Sema::FoldStats Stats;
+        {
+            PhaseReport::Region Time(&Report, "sema");
+            if (Semantic.semantic(Tree))
+                return true;
+        }
+        {
+            PhaseReport::Region Time(&Report, "fold");
+            Semantic.fold(Tree, Stats);
+        }
+
+        CodeGen CodeGenerator(OptLevel);
+        CodeGenerator.setReport(&Report);
+        if (EmitObj)
+            return CodeGenerator.compile(Tree, "/dev/null", CodeGen::EmitObj);
+        llvm::LLVMContext Ctx;
+        return !CodeGenerator.generate(Tree, Ctx);
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM pipeline benchmark\n");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    if (Sizes.empty())
+        for (unsigned Size : {1000, 10000, 100000, 1000000})
+            Sizes.push_back(Size);
+
+    Generator Gen(Seed);
+    if (PrintProgram)
+    {
+        llvm::outs() << Gen.generate(Sizes.front());
+        return 0;
+    }
+
+    static const char *const Phases[] = {"lex", "parse", "sema", "fold", "irgen", "optimize", "emit"};
+    unsigned NumPhases = EmitObj ? 7 : 6;
+    if (!JSON)
+    {
+        llvm::outs() << "                             ns per statement\n";
+        llvm::outs() << "statements      MB";
+        for (unsigned P = 0; P != NumPhases; ++P)
+            llvm::outs() << llvm::format("%9s", Phases[P]);
+        llvm::outs() << "   total ms   kstmt/s\n";
+    }
+    for (unsigned Size : Sizes)
+    {
+        std::string Source = Gen.generate(Size);
+        PhaseReport Report(std::to_string(Size) + " statements");
+        if (compile(Source, Report))
+        {
+            llvm::errs() << "The generated program of " << Size << " statements does not compile\n";
+            return 1;
+        }
+        if (JSON)
+        {
+            Report.printJSON(llvm::outs());
+            continue;
+        }
+
+        // The lex column is not part of the total, lexing is timed again
+        // inside parse.
+        double Total = 0;
+        llvm::outs() << llvm::format("%10u %7.1f", Size, Source.size() / 1048576.0);
+        for (unsigned P = 0; P != NumPhases; ++P)
+        {
+            double Time = Report.getWallTime(Phases[P]);
+            if (P != 0)
+                Total += Time;
+            llvm::outs() << llvm::format("%9.1f", Time * 1e6 / Size);
+        }
+        llvm::outs() << llvm::format(" %10.1f %9.1f\n", Total, Size / Total);
+    }
+    return 0;
+}
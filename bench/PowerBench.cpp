@@ -0,0 +1,88 @@
+// Runs a loop of power-heavy GSM expressions in the JIT and reports the
+// execution time with the exponent written as a literal, which is unrolled
+// into multiplications, and with the exponent in a variable, which calls the
+// exponentiation-by-squaring helper. The runtime is replaced by a checksum.
+#include "BenchJIT.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+static llvm::cl::opt<unsigned>
+    Iterations("iterations",
+               llvm::cl::desc("Upper bound of the loop counter of the GSM loop"),
+               llvm::cl::init(30000000));
+
+static llvm::cl::opt<unsigned>
+    Exponent("exponent",
+             llvm::cl::desc("Exponent of the powers in the loop"),
+             llvm::cl::init(13));
+
+static llvm::cl::opt<bool>
+    PrintIR("print-ir",
+            llvm::cl::desc("Print the optimized module of each run"));
+
+namespace
+{
+    // Returns a loop whose counter advances by an amount computed from three
+    // powers of it, so that every iteration depends on the powers.
+    std::string makeProgram(const std::string &Exp)
+    {
+        return "int n = " + std::to_string(Iterations) + ";\n"
+               "int e = " + std::to_string(Exponent) + ";\n"
+               "int i = 0;\n"
+               "loopc i < n :\n"
+               "begin\n"
+               "    i += (i ^ " + Exp + " + (i + 3) ^ " + Exp + " + (i + 5) ^ " + Exp + ") % 3 + 3;\n"
+               "end\n";
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM power benchmark\n");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string Unrolled = makeProgram(std::to_string(Exponent));
+    std::string Helper = makeProgram("e");
+    // The folder is skipped so that a variable exponent is not replaced by
+    // its value.
+    auto Run = [](const std::string &Source, unsigned OptLevel, BenchResult &Res)
+    {
+        BenchOptions Opts;
+        Opts.OptLevel = OptLevel;
+        Opts.Fold = false;
+        Opts.PrintIR = PrintIR;
+        return runBenchProgram(Source, Opts, Res);
+    };
+    BenchResult Runs[4];
+    if (Run(Unrolled, 0, Runs[0]) || Run(Helper, 0, Runs[1]) || Run(Unrolled, 3, Runs[2]) ||
+        Run(Helper, 3, Runs[3]))
+    {
+        llvm::errs() << "Cannot compile the benchmark program\n";
+        return 1;
+    }
+    for (const BenchResult &Res : Runs)
+        if (Res.Checksum != Runs[0].Checksum)
+        {
+            llvm::errs() << "The results of the runs differ\n";
+            return 1;
+        }
+
+    auto Print = [](const char *Name, const BenchResult &Res)
+    {
+        llvm::outs() << llvm::format("%-13s %9.3f ms execute\n", Name, Res.ExecuteTime);
+    };
+    Print("-O0 unrolled:", Runs[0]);
+    Print("-O0 helper:", Runs[1]);
+    Print("-O3 unrolled:", Runs[2]);
+    Print("-O3 helper:", Runs[3]);
+    llvm::outs() << llvm::format("unrolled vs helper: %.2fx at -O0, %.2fx at -O3\n",
+                                 Runs[1].ExecuteTime / Runs[0].ExecuteTime,
+                                 Runs[3].ExecuteTime / Runs[2].ExecuteTime);
+    return 0;
+}
@@ -1,14 +1,51 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void gsm_write(int v)
 {
     printf("The result is: %d\n", v);
 }
 
+/* The output of gsm_write_buffered, written by gsm_flush. */
+static char out_buf[1 << 16];
+static size_t out_len;
+
+void gsm_flush(void)
+{
+    fwrite(out_buf, 1, out_len, stdout);
+    fflush(stdout);
+    out_len = 0;
+}
+
+/* Formats like gsm_write, without going through printf. */
+void gsm_write_buffered(int v)
+{
+    static const char prefix[] = "The result is: ";
+    char digits[12];
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+    int n = 0;
+    do
+        digits[n++] = '0' + u % 10;
+    while (u /= 10);
+    if (v < 0)
+        digits[n++] = '-';
+
+    if (out_len + sizeof(prefix) + n + 1 > sizeof(out_buf))
+        gsm_flush();
+    memcpy(out_buf + out_len, prefix, sizeof(prefix) - 1);
+    out_len += sizeof(prefix) - 1;
+    while (n)
+        out_buf[out_len++] = digits[--n];
+    out_buf[out_len++] = '\n';
+}
+
 int gsm_read(char *s)
 {
     char buf[64];
+    /* The prompt follows the output written so far. */
+    if (out_len)
+        gsm_flush();
     int val;
     printf("Enter a value for %s: ", s);
     fgets(buf, sizeof(buf), stdin);
@@ -18,4 +55,17 @@ int gsm_read(char *s)
         exit(1);
     }
     return val;
-}
\ No newline at end of file
+}
+void gsm_prof_dump(const unsigned long long *counts, int n, const char *file)
+{
+    FILE *f = fopen(file, "w");
+    if (!f)
+    {
+        printf("Cannot write the profile %s\n", file);
+        return;
+    }
+    fprintf(f, "gsm-profile\n%d\n", n);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "%llu\n", counts[i]);
+    fclose(f);
+}
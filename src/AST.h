@@ -1,29 +1,28 @@
 #ifndef AST_H
 #define AST_H
 
-#include "llvm/ADT/SmallVector.h"
+#include "ASTContext.h"
+#include "Expr.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 
 // Forward declarations of classes used in the AST
 // AST class serves as the base class for all AST nodes
+// All nodes are allocated in an ASTContext and are never deleted one by one,
+// so they only hold trivially destructible members; lists are ArrayRefs into
+// the context. Expressions are stored flat in the ExprPool of the context
+// (see Expr.h) and the statements refer to them by ExprId.
 class AST;
 class ASTVisitor;
 class Grammer;
 class DecNode;
 class AssignNode;
-class ComparisonNode;
-class LogicNode;
-class ExprNode;
-class FactorNode;
-class BinaryOp;
 class ConditionNode;
 class IfPartNode;
 class ElifPartNode;
 class ElsePartNode;
 class LoopNode;
 class GrammerNode;
-class TermNode;
-class PowerNode;
 
 class AST
 {
@@ -37,235 +36,100 @@ class ASTVisitor
 public:
   // Virtual visit functions for each AST node type
   virtual void visit(AST &) {}               // Visit the base AST node
-  virtual void visit(Expr &) {}              // Visit the expression node
-  virtual void visit(GSM &) = 0;             // Visit the group of expressions node
-  virtual void visit(Factor &) = 0;          // Visit the factor node
-  virtual void visit(BinaryOp &) = 0;        // Visit the binary operation node
-  virtual void visit(Assignment &) = 0;      // Visit the assignment expression node
-  virtual void visit(Declaration &) = 0;     // Visit the variable declaration node
+  virtual void visit(GrammerNode &) = 0;     // Visit the group of statements node
+  virtual void visit(DecNode &) = 0;         // Visit the variable declaration node
+  virtual void visit(AssignNode &) = 0;      // Visit the assignment node
+  virtual void visit(ConditionNode &) {}     // Visit the if/elif/else node
+  virtual void visit(IfPartNode &) {}        // Visit the if part node
+  virtual void visit(ElifPartNode &) {}      // Visit the elif part node
+  virtual void visit(ElsePartNode &) {}      // Visit the else part node
+  virtual void visit(LoopNode &) {}          // Visit the loop node
 };
 
-class Grammer
+class Grammer : public AST
 {
-public:
-  virtual ~Grammer() {}
-  virtual void accept(ASTVisitor &V) = 0; // Accept a visitor for traversal
+  // Represents a statement
 };
 
 class DecNode : public Grammer
 {
 public:
   DecNode(
-      const llvm::SmallVector<llvm::StringRef> identifiers,
-      const llvm::SmallVector<ComparisonNode *> expressions) : identifiers(identifiers), expressions(expressions) {}
+      llvm::ArrayRef<llvm::StringRef> identifiers,
+      llvm::ArrayRef<SymbolId> symbols,
+      llvm::ArrayRef<ExprId> expressions) : identifiers(identifiers), symbols(symbols), expressions(expressions) {}
 
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
   }
 
-  void maker(DecNode &decNode)
-  {
-    // Implementation for creating a declaration node
-    // ...
-  }
-
-  llvm::SmallVector<llvm::StringRef> identifiers;
-  llvm::SmallVector<ComparisonNode *> expressions;
+  llvm::ArrayRef<llvm::StringRef> identifiers;
+  llvm::ArrayRef<SymbolId> symbols; // interned identifiers
+  llvm::ArrayRef<ExprId> expressions; // one initial value per identifier
 };
 
 class AssignNode : public Grammer
 {
+public:
   enum Token
   {
     EQUAL,
     PLUS_EQUAL,
     MINUS_EQUAL,
     MULT_EQUAL,
-    DIVIDE_EQUAL
+    DIVIDE_EQUAL,
     MOD_EQUAL
   };
 
-public:
-  AssignNode(Factor *identifier, Token op, ComparisonNode *expression) : identifier(identifier), op(op), expression(expression){}
-  virtual void accept(ASTVisitor &V) override
-  {
-    V.visit(*this);
-  }
-
-  void Grammer::maker(AssignNode &assignNode)
-  {
-    // Implementation for creating an assignment node
-    // ...
-  }
-
-private:
-  llvm::StringRef identifier;
-  Token op; // "=", "+=", "-=", "*=", "/="
-  ComparisonNode *expression;
-};
-
-// Now, let's implement the corresponding maker functions in your Grammer class:
-
-class ComparisonNode : public ASTNode
-{
-public:
-  enum BoolOp
-  {
-    AND,
-    OR
-  };
-
-  ComparisonNode(
-      LogicNode *left,
-      BoolOp operation,
-      ComparisonNode *right)
-      : left(left), operation(operation), right(right) {}
+  AssignNode(llvm::StringRef identifier, SymbolId symbol, Token op, ExprId expression)
+      : identifier(identifier), symbol(symbol), op(op), expression(expression) {}
 
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
   }
 
-  static ComparisonNode *maker(LogicNode *left, BoolOp operation, ComparisonNode *right)
-  {
-    return new ExprNode(left, operation, right);
-  }
+  llvm::StringRef getIdentifier() { return identifier; }
 
-private:
-  LogicNode *left;
-  BoolOp operation;
-  ComparisonNode *right;
-};
+  SymbolId getSymbol() { return symbol; }
 
-class LogicNode : public ComparisonNode
-{
-public:
-  enum ComparisonOp
-  {
-    LESS_THAN,
-    GREATER_THAN,
-    LESS_THAN_EQUAL,
-    GREATER_THAN_EQUAL,
-    EQUAL,
-    NOT_EQUAL
-  };
+  Token getOp() { return op; }
 
-  LogicNode(
-      ExprNode *ExprNode,
-      ComparisonOp operation,
-      LogicNode *LogicNode)
-      : ExprNode(ExprNode), operation(operation), logicNode(LogicNode) {}
+  void setOp(Token Op) { op = Op; }
 
-  virtual void accept(ASTVisitor &V) override
-  {
-    V.visit(*this);
-  }
+  ExprId getExpr() { return expression; }
 
 private:
-  ExprNode *ExprNode;
-  ComparisonOp operation;
-  LogicNode *logicNode;
-};
-
-class ExprNode : public LogicNode
-{
-public:
-  enum ExprOp
-  {
-    plus,
-    minus
-  };
-
-  LogicNode(
-      ExprNode *left,
-      ExprOp operation,
-      ExprNode *right)
-      : left(left), operation(operation), right(right) {}
-
-  virtual void accept(ASTVisitor &V) override
-  {
-    V.visit(*this);
-  }
-
-private:
-  TermNode *left;
-  ExprOp operation;
-  ExprNode *right;
+  llvm::StringRef identifier;
+  SymbolId symbol;
+  Token op; // "=", "+=", "-=", "*=", "/=", "%="
+  ExprId expression;
 };
 
-class TermNode : public ExprNode
+class IfPartNode : public Grammer
 {
+  // Represents if Part node
 public:
-  enum TermOp
-  {
-    star,
-    devide,
-    precent
-  };
-
-  LogicNode(
-      PowerNode *left,
-      TermOp operation,
-      TermNode *right)
-      : left(left), operation(operation), right(right) {}
-
-  virtual void accept(ASTVisitor &V) override
-  {
-    V.visit(*this);
-  }
+  ExprId condition;
+  llvm::ArrayRef<AssignNode *> assigns;
 
-private:
-  PowerNode *left;
-  TermOp operation;
-  TermNode *right;
-};
-
-class PowerNode : public TermNode
-{
-public:
-  PowerNode(
-      FactorNode *left,
-      PowerNode *right)
-      : left(left), right(right) {}
+  IfPartNode(ExprId condition, llvm::ArrayRef<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
 
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
   }
-
-private:
-  FactorNode *left;
-  PowerNode *right;
 };
 
-class BinaryOp : public ExprNode
+class ElifPartNode : public Grammer
 {
-  // Represents begin-end block node
-public:
-  enum Operator
-  {
-    Plus,
-    Minus,
-    Mul,
-    Div,
-    power,
-    mod,
-  };
-
-private:
-  ExprNode *Left;  // Left-hand side expression
-  ExprNode *Right; // Right-hand side expression
-  Operator Op;     // Operator of the binary operation
-
+  // Represents elif Part node
 public:
-  BinaryOp(Operator Op, ExprNode *L, ExprNode *R) : Op(Op), Left(L), Right(R) {}
+  ExprId condition;
+  llvm::ArrayRef<AssignNode *> assigns;
 
-  ExprNode *getLeft() { return Left; }
-
-  ExprNode *getRight() { return Right; }
-
-  Operator getOperator() { return Op; }
+  ElifPartNode(ExprId condition, llvm::ArrayRef<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
 
   virtual void accept(ASTVisitor &V) override
   {
@@ -273,25 +137,13 @@ public:
   }
 };
 
-class Factor : public Expr
+class ElsePartNode : public Grammer
 {
+  // Represents else Part node
 public:
-  enum ValueKind
-  {
-    Ident,
-    Number
-  };
-
-private:
-  ValueKind Kind;      // Stores the kind of factor (identifier or number)
-  llvm::StringRef Val; // Stores the value of the factor
-
-public:
-  Factor(ValueKind Kind, llvm::StringRef Val) : Kind(Kind), Val(Val) {}
+  llvm::ArrayRef<AssignNode *> assigns;
 
-  ValueKind getKind() { return Kind; }
-
-  llvm::StringRef getVal() { return Val; }
+  ElsePartNode(llvm::ArrayRef<AssignNode *> assigns) : assigns(assigns) {}
 
   virtual void accept(ASTVisitor &V) override
   {
@@ -299,23 +151,16 @@ public:
   }
 };
 
-class ConditionNode : public ASTNode
+class ConditionNode : public Grammer
 {
   // Represents condition node
 public:
   IfPartNode *ifPart;
-  llvm::SmallVector<ElifPartNode *> elifParts;
-  ElsePartNode *elseParts;
-};
-
-class IfPartNode : public ASTNode
-{
-  // Represents if Part node
-public:
-  ComparisonNode *condition;
-  llvm::SmallVector<AssignNode *> assigns;
+  llvm::ArrayRef<ElifPartNode *> elifParts;
+  ElsePartNode *elseParts; // null if there is no else part
 
-  IfPartNode(ComparisonNode *condition, llvm::SmallVector<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
+  ConditionNode(IfPartNode *ifPart, llvm::ArrayRef<ElifPartNode *> elifParts, ElsePartNode *elseParts)
+      : ifPart(ifPart), elifParts(elifParts), elseParts(elseParts) {}
 
   virtual void accept(ASTVisitor &V) override
   {
@@ -323,14 +168,14 @@ public:
   }
 };
 
-class ElifPartNode : public ASTNode
+class LoopNode : public Grammer
 {
-  // Represents elif Part node
+  // Represents loop node
 public:
-  ComparisonNode *condition;
-  llvm::SmallVector<AssignNode *> assigns;
+  ExprId condition;
+  llvm::ArrayRef<AssignNode *> assigns;
 
-  ElifPartNode(ComparisonNode *condition, llvm::SmallVector<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
+  LoopNode(ExprId condition, llvm::ArrayRef<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
 
   virtual void accept(ASTVisitor &V) override
   {
@@ -338,28 +183,17 @@ public:
   }
 };
 
-class ElsePartNode : public ASTNode
+class GrammerNode : public AST
 {
-  // Represents else Part node
-public:
-  llvm::SmallVector<AssignNode *> assigns;
-
-  ElsePartNode(llvm::SmallVector<AssignNode *> assigns) : assigns(assigns) {}
-
-  virtual void accept(ASTVisitor &V) override
-  {
-    V.visit(*this);
-  }
-};
+  // Represents Grammer node
+  ASTContext &Ctx; // context owning the nodes and expressions of the program
 
-class LoopNode : public ASTNode
-{
-  // Represents loop node
 public:
-  ComparisonNode *condition;
-  llvm::SmallVector<AssignNode *> assigns;
+  llvm::ArrayRef<Grammer *> statements;
+
+  GrammerNode(ASTContext &Ctx, llvm::ArrayRef<Grammer *> statements) : Ctx(Ctx), statements(statements) {}
 
-  LoopNode(ComparisonNode *condition, llvm::SmallVector<AssignNode *> assigns) : condition(condition), assigns(assigns) {}
+  ASTContext &getContext() { return Ctx; }
 
   virtual void accept(ASTVisitor &V) override
   {
@@ -367,9 +201,4 @@ public:
   }
 };
 
-class GrammerNode : public ASTNode
-{
-  // Represents Grammer node
-public:
-  std::vector<std::shared_ptr<ASTNode>> statements;
-};
+#endif
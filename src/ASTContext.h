@@ -0,0 +1,58 @@
+#ifndef ASTCONTEXT_H
+#define ASTCONTEXT_H
+
+#include "Expr.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Allocator.h"
+#include <memory>
+#include <utility>
+
+// Owns every AST node of a compilation. The nodes are carved out of the slabs
+// of a bump allocator and released all at once; their destructors never run,
+// so nodes keep their child lists in the context as well (see copy()).
+// Expressions are not nodes but live in the flat ExprPool of the context,
+// which also interns the identifiers.
+class ASTContext
+{
+  llvm::BumpPtrAllocator Allocator;
+  ExprPool Exprs;
+  size_t NumNodes = 0; // nodes created since the last reset()
+
+public:
+  ExprPool &getExprs() { return Exprs; }
+
+  // Allocates a node of type T in the context.
+  template <typename T, typename... Args>
+  T *create(Args &&...args)
+  {
+    ++NumNodes;
+    return new (Allocator.Allocate<T>()) T(std::forward<Args>(args)...);
+  }
+
+  // Copies a temporary list, e.g. a SmallVector of children, into the context.
+  template <typename T>
+  llvm::ArrayRef<T> copy(llvm::ArrayRef<T> List)
+  {
+    if (List.empty())
+      return llvm::ArrayRef<T>();
+    T *Mem = Allocator.Allocate<T>(List.size());
+    std::uninitialized_copy(List.begin(), List.end(), Mem);
+    return llvm::ArrayRef<T>(Mem, List.size());
+  }
+
+  // Releases all nodes in one shot. Pointers into the AST become invalid.
+  void reset()
+  {
+    Allocator.Reset();
+    Exprs.clear();
+    NumNodes = 0;
+  }
+
+  size_t getBytesAllocated() const { return Allocator.getBytesAllocated(); }
+
+  // Returns the number of statement nodes; expressions are counted by the
+  // pool.
+  size_t getNumNodes() const { return NumNodes; }
+};
+
+#endif
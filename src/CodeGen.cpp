@@ -1,172 +1,1080 @@
 #include "CodeGen.h"
+#include "JIT.h"
+#include "Optimizer.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
+#include <cstdio>
 
 using namespace llvm;
 
+namespace
+{
+  // Counts the arms of the if statements of a program: every if statement
+  // has one arm per condition plus one for the else part, which is the
+  // empty arm when there is no else part.
+  class ArmCounter : public ASTVisitor
+  {
+  public:
+    unsigned NumArms = 0;
+
+    virtual void visit(GrammerNode &Node) override
+    {
+      for (Grammer *G : Node.statements)
+        G->accept(*this);
+    }
+
+    virtual void visit(DecNode &) override {}
+
+    virtual void visit(AssignNode &) override {}
+
+    virtual void visit(ConditionNode &Node) override { NumArms += Node.elifParts.size() + 2; }
+  };
+}
+
 // Define a visitor class for generating LLVM IR from the AST.
 namespace
 {
+  // The functions of the runtime in rtGSM.c the generated code calls.
+  enum RuntimeFunction
+  {
+    RtWrite,         // void gsm_write(int)
+    RtWriteBuffered, // void gsm_write_buffered(int)
+    RtFlush,         // void gsm_flush(void)
+    RtProfDump,      // void gsm_prof_dump(const unsigned long long *, int, const char *)
+    NumRuntimeFunctions
+  };
+
+  const char *const RuntimeNames[NumRuntimeFunctions] = {"gsm_write", "gsm_write_buffered", "gsm_flush",
+                                                          "gsm_prof_dump"};
+
   class ToIRVisitor : public ASTVisitor
   {
     Module *M;
+    Function *MainFn;          // the function the statements are generated into
+    BasicBlock *InsertBefore;  // new blocks go in front of it, at the end if null
+    AllocaInst *LastAlloca;    // the allocas of the variables are kept together
     IRBuilder<> Builder;
     Type *VoidTy;
     Type *Int32Ty;
+    Type *Int64Ty;
     Type *Int8PtrTy;
     Type *Int8PtrPtrTy;
     Constant *Int32Zero;
 
-    Value *V;
-    StringMap<AllocaInst *> nameMap;
+    ExprPool *Exprs;
+    SmallVector<Value *, 32> Vals; // values of the expression nodes being generated
+    ExprId ValsFirst;              // the node whose value is Vals[0]
+    std::vector<unsigned> Costs;   // speculation costs of the same nodes, see computeCosts
+    std::vector<AllocaInst *> Variables; // memory of each variable, indexed by symbol
+    bool HasError;
+
+    // Profiles count how often each arm of each if statement is taken. The
+    // arms are numbered in program order, see ArmCounter.
+    std::string ProfileFile;     // written by an instrumented program, or empty
+    GlobalVariable *Counters;    // the counters of an instrumented program
+    ArrayRef<uint64_t> Profile;  // counts read from an earlier run, or empty
+    unsigned NumArms;            // arms generated so far
+
+    // The types of the runtime functions, declared on first use.
+    FunctionType *RuntimeTypes[NumRuntimeFunctions];
+    bool BufferOutput; // write through the runtime buffer, flushed when main returns
+
+    void unsupported(StringRef What)
+    {
+      errs() << What << " is not supported by the code generator yet\n";
+      HasError = true;
+    }
 
   public:
     // Constructor for the visitor class.
-    ToIRVisitor(Module *M) : M(M), Builder(M->getContext())
+    ToIRVisitor(Module *M)
+        : M(M), MainFn(nullptr), InsertBefore(nullptr), LastAlloca(nullptr), Builder(M->getContext()),
+          Exprs(nullptr), HasError(false), Counters(nullptr), NumArms(0), BufferOutput(false)
     {
       // Initialize LLVM types and constants.
       VoidTy = Type::getVoidTy(M->getContext());
       Int32Ty = Type::getInt32Ty(M->getContext());
+      Int64Ty = Type::getInt64Ty(M->getContext());
       Int8PtrTy = Type::getInt8PtrTy(M->getContext());
       Int8PtrPtrTy = Int8PtrTy->getPointerTo();
       Int32Zero = ConstantInt::get(Int32Ty, 0, true);
+
+      RuntimeTypes[RtWrite] = RuntimeTypes[RtWriteBuffered] = FunctionType::get(VoidTy, {Int32Ty}, false);
+      RuntimeTypes[RtFlush] = FunctionType::get(VoidTy, false);
+      RuntimeTypes[RtProfDump] = FunctionType::get(VoidTy, {Int64Ty->getPointerTo(), Int32Ty, Int8PtrTy}, false);
     }
 
-    // Entry point for generating LLVM IR from the AST.
-    void run(AST *Tree)
+    // Returns the declaration of a runtime function. The module holds a
+    // single declaration of each, however often it is called.
+    FunctionCallee getRuntimeFunction(RuntimeFunction F)
+    {
+      return M->getOrInsertFunction(RuntimeNames[F], RuntimeTypes[F]);
+    }
+
+    // Creates the main function with its entry block.
+    BasicBlock *createMain()
     {
-      // Create the main function with the appropriate function type.
       FunctionType *MainFty = FunctionType::get(Int32Ty, {Int32Ty, Int8PtrPtrTy}, false);
-      Function *MainFn = Function::Create(MainFty, GlobalValue::ExternalLinkage, "main", M);
+      MainFn = Function::Create(MainFty, GlobalValue::ExternalLinkage, "main", M);
+      return BasicBlock::Create(M->getContext(), "entry", MainFn);
+    }
+
+    // Makes the program count how often each arm of its if statements is
+    // taken and write the counts to File when it exits.
+    void instrument(StringRef File) { ProfileFile = File.str(); }
 
-      // Create a basic block for the entry point of the main function.
-      BasicBlock *BB = BasicBlock::Create(M->getContext(), "entry", MainFn);
-      Builder.SetInsertPoint(BB);
+    // Weights the branches of the if statements with the counts of an
+    // instrumented run of the same program.
+    void useProfile(ArrayRef<uint64_t> Counts) { Profile = Counts; }
+
+    // Makes the assignments append their output to a buffer of the runtime,
+    // which is written in one go when main returns.
+    void bufferOutput() { BufferOutput = true; }
+
+    // Entry point for generating LLVM IR from the AST. Returns true if the
+    // AST uses a construct that cannot be generated.
+    bool run(AST *Tree)
+    {
+      Builder.SetInsertPoint(createMain());
+
+      ArmCounter Arms;
+      Tree->accept(Arms);
+      if (!Profile.empty() && Profile.size() != Arms.NumArms)
+      {
+        errs() << "warning: the profile is from a different program and is ignored\n";
+        Profile = None;
+      }
+      if (!ProfileFile.empty())
+      {
+        Type *CountersTy = ArrayType::get(Int64Ty, Arms.NumArms);
+        Counters = new GlobalVariable(*M, CountersTy, false, GlobalValue::InternalLinkage,
+                                      Constant::getNullValue(CountersTy), "gsm.arm.counters");
+      }
 
       // Visit the root node of the AST to generate IR.
       Tree->accept(*this);
 
+      // Write the profile before returning from main.
+      if (Counters)
+        Builder.CreateCall(getRuntimeFunction(RtProfDump), {Builder.CreateConstGEP2_32(Counters->getValueType(), Counters, 0, 0),
+                                  ConstantInt::get(Int32Ty, Arms.NumArms),
+                                  Builder.CreateGlobalStringPtr(ProfileFile)});
+      if (BufferOutput)
+        Builder.CreateCall(getRuntimeFunction(RtFlush));
+
       // Create a return instruction at the end of the main function.
       Builder.CreateRet(Int32Zero);
+      return HasError;
+    }
+
+    // Generates a single top-level statement into new blocks in front of
+    // Before, for IncrementalCodeGen. The blocks run from First to Last in
+    // the function; Last is left without a terminator. Returns true if the
+    // statement cannot be generated.
+    bool emitStatement(Grammer *Stmt, ExprPool &Pool, BasicBlock *Before, BasicBlock *&First,
+                       BasicBlock *&Last)
+    {
+      Exprs = &Pool;
+      InsertBefore = Before;
+      HasError = false;
+      First = BasicBlock::Create(M->getContext(), "", MainFn, Before);
+      Builder.SetInsertPoint(First);
+      Stmt->accept(*this);
+      Last = Builder.GetInsertBlock();
+      return HasError;
+    }
+
+    // Returns the memory of a variable. It is allocated in the entry block
+    // on first use, so statements can be generated in any order.
+    AllocaInst *getVariable(SymbolId Symbol)
+    {
+      if (Symbol >= Variables.size())
+        Variables.resize(Exprs->getNumSymbols());
+      AllocaInst *&Alloca = Variables[Symbol];
+      if (Alloca)
+        return Alloca;
+      BasicBlock &Entry = MainFn->getEntryBlock();
+      IRBuilder<> AllocaBuilder(&Entry, LastAlloca ? std::next(LastAlloca->getIterator()) : Entry.begin());
+      Alloca = LastAlloca = AllocaBuilder.CreateAlloca(Int32Ty, nullptr, Exprs->getSymbolName(Symbol));
+      return Alloca;
     }
 
-    // Visit function for the GSM node in the AST.
-    virtual void visit(GSM &Node) override
+    // The cost of an expression that may trap when it is evaluated although
+    // its value is not needed.
+    static const unsigned Unsafe = ~0U;
+
+    // The largest cost of the right operand of an and or an or, in
+    // instructions, for which evaluating it unconditionally is cheaper than
+    // a branch that may be mispredicted.
+    static const unsigned SpeculationBudget = 6;
+
+    // Estimates the number of instructions each node of the range from
+    // First to E generates together with its operands, or Unsafe if they
+    // divide by a value that may be 0 or -1. A single forward scan sees the
+    // operands of every node before the node itself, so each cost is
+    // computed once, into Costs[I - First].
+    void computeCosts(ExprId First, ExprId E)
     {
-      // Iterate over the children of the GSM node and visit each child.
-      for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+      Costs.resize(E - First + 1);
+      for (ExprId I = First; I <= E; ++I)
       {
-        (*I)->accept(*this);
+        const Expr &Node = (*Exprs)[I];
+        unsigned &Cost = Costs[I - First];
+        switch (Node.Kind)
+        {
+        case Expr::Number:
+          Cost = 0;
+          continue;
+        case Expr::Ident:
+          Cost = 1;
+          continue;
+        case Expr::Div:
+        case Expr::Mod:
+          // A division by a constant becomes a multiplication and shifts.
+          Cost = isSafeDivisor(Node.RHS) ? 4 : Unsafe;
+          break;
+        case Expr::Power:
+          Cost = 8;
+          break;
+        default:
+          Cost = 1;
+          break;
+        }
+        for (ExprId Op : {Node.LHS, Node.RHS})
+          Cost = Cost == Unsafe || Costs[Op - First] == Unsafe ? Unsafe : Cost + Costs[Op - First];
       }
-    };
+    }
 
-    virtual void visit(Assignment &Node) override
+    // Estimates the number of instructions the subtree of E generates, or
+    // returns Unsafe if it divides by a value that may be 0 or -1.
+    unsigned getSpeculationCost(ExprId E)
     {
-      // Visit the right-hand side of the assignment and get its value.
-      Node.getRight()->accept(*this);
-      Value *val = V;
+      computeCosts(Exprs->first(E), E);
+      return Costs.back();
+    }
 
-      // Get the name of the variable being assigned.
-      auto varName = Node.getLeft()->getVal();
+    // Tests if the right operand of an and or an or is evaluated only when
+    // the left one does not decide the result. Otherwise both operands are
+    // evaluated and combined without a branch, which is better for the
+    // short and unpredictable conditions of tight loops; the operands have
+    // no side effects, so this only costs the time of the right operand.
+    // The costs are those of the expression being generated.
+    bool isShortCircuit(const Expr &Node)
+    {
+      return (Node.Kind == Expr::And || Node.Kind == Expr::Or) &&
+             Costs[Node.RHS - ValsFirst] > SpeculationBudget;
+    }
 
-      // Create a store instruction to assign the value to the variable.
-      Builder.CreateStore(val, nameMap[varName]);
+    // Generates an and or an or whose right operand is evaluated in a block
+    // of its own, given the value of the left operand.
+    Value *emitShortCircuit(const Expr &Node, Value *LHS)
+    {
+      bool IsAnd = Node.Kind == Expr::And;
+      BasicBlock *From = Builder.GetInsertBlock();
+      BasicBlock *RHSBlock = createBlock(IsAnd ? "and.rhs" : "or.rhs");
+      // The end block is added last, after the blocks of the right operand.
+      BasicBlock *End = BasicBlock::Create(M->getContext(), IsAnd ? "and.end" : "or.end");
+      Value *L = toBool(LHS);
+      Builder.CreateCondBr(L, IsAnd ? RHSBlock : End, IsAnd ? End : RHSBlock);
 
-      // Create a function type for the "gsm_write" function.
-      FunctionType *CalcWriteFnTy = FunctionType::get(VoidTy, {Int32Ty}, false);
+      // The values of the operand go to its own range of the value buffer
+      // of the enclosing expression.
+      Builder.SetInsertPoint(RHSBlock);
+      Value *R = toBool(emitRange(Exprs->first(Node.RHS), Node.RHS));
+      BasicBlock *RHSEnd = Builder.GetInsertBlock();
+      Builder.CreateBr(End);
 
-      // Create a function declaration for the "gsm_write" function.
-      Function *CalcWriteFn = Function::Create(CalcWriteFnTy, GlobalValue::ExternalLinkage, "gsm_write", M);
+      End->insertInto(MainFn, InsertBefore);
+      Builder.SetInsertPoint(End);
+      PHINode *Phi = Builder.CreatePHI(L->getType(), 2);
+      Phi->addIncoming(ConstantInt::getBool(M->getContext(), !IsAnd), From);
+      Phi->addIncoming(R, RHSEnd);
+      return Builder.CreateZExt(Phi, Int32Ty);
+    }
 
-      // Create a call instruction to invoke the "gsm_write" function with the value.
-      CallInst *Call = Builder.CreateCall(CalcWriteFnTy, CalcWriteFn, {val});
-    };
+    // Generates the value of an expression. Operands precede their users in
+    // the pool, so a single forward scan over the range [first(E), E] sees
+    // the operands of every node before the node itself. The right operands
+    // of short-circuit nodes are skipped by the scan and generated by the
+    // node itself.
+    Value *emit(ExprId E)
+    {
+      ValsFirst = Exprs->first(E);
+      computeCosts(ValsFirst, E);
+      Vals.resize(E - ValsFirst + 1);
+      return emitRange(ValsFirst, E);
+    }
 
-    virtual void visit(Factor &Node) override
+    // Generates the nodes from First to E, the subtree of E, into Vals.
+    Value *emitRange(ExprId First, ExprId E)
     {
-      if (Node.getKind() == Factor::Ident)
+      // A backward scan finds the skipped ranges without entering them, so
+      // the nodes of nested short-circuit operands are not scanned again by
+      // every enclosing expression.
+      SmallVector<std::pair<ExprId, ExprId>, 4> Skipped;
+      for (ExprId I = E + 1; I-- > First;)
+        if (isShortCircuit((*Exprs)[I]))
+        {
+          Skipped.push_back({Exprs->first((*Exprs)[I].RHS), (*Exprs)[I].RHS});
+          I = Skipped.back().first;
+        }
+      std::reverse(Skipped.begin(), Skipped.end());
+      auto Skip = Skipped.begin();
+
+      for (ExprId I = First; I <= E; ++I)
       {
-        // If the factor is an identifier, load its value from memory.
-        V = Builder.CreateLoad(Int32Ty, nameMap[Node.getVal()]);
+        while (Skip != Skipped.end() && Skip->first < I)
+          ++Skip;
+        if (Skip != Skipped.end() && Skip->first == I)
+        {
+          I = Skip->second;
+          continue;
+        }
+        const Expr &Node = (*Exprs)[I];
+        Value *&Res = Vals[I - ValsFirst];
+        switch (Node.Kind)
+        {
+        case Expr::Number:
+          // If the node is a literal, create a constant.
+          Res = ConstantInt::get(Int32Ty, Node.getValue(), true);
+          break;
+        case Expr::Ident:
+          // If the node is an identifier, load its value from memory.
+          Res = Builder.CreateLoad(Int32Ty, getVariable(Exprs->getSymbol(I)));
+          break;
+        case Expr::Plus:
+          Res = Builder.CreateNSWAdd(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::Minus:
+          Res = Builder.CreateNSWSub(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::Mul:
+          Res = Builder.CreateNSWMul(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::Div:
+          Res = Builder.CreateSDiv(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::Mod:
+          Res = Builder.CreateSRem(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::Power:
+          Res = emitPower(Vals[Node.LHS - ValsFirst], Vals[Node.RHS - ValsFirst]);
+          break;
+        case Expr::LessThan:
+        case Expr::GreaterThan:
+        case Expr::LessThanEqual:
+        case Expr::GreaterThanEqual:
+        case Expr::Equal:
+        case Expr::NotEqual:
+        {
+          // Comparisons yield 1 or 0.
+          static const CmpInst::Predicate Preds[] = {CmpInst::ICMP_SLT, CmpInst::ICMP_SGT, CmpInst::ICMP_SLE,
+                                                     CmpInst::ICMP_SGE, CmpInst::ICMP_EQ, CmpInst::ICMP_NE};
+          Value *Cmp = Builder.CreateICmp(Preds[Node.Kind - Expr::LessThan], Vals[Node.LHS - ValsFirst],
+                                          Vals[Node.RHS - ValsFirst]);
+          Res = Builder.CreateZExt(Cmp, Int32Ty);
+          break;
+        }
+        case Expr::And:
+        case Expr::Or:
+        {
+          if (isShortCircuit(Node))
+          {
+            Res = emitShortCircuit(Node, Vals[Node.LHS - ValsFirst]);
+            break;
+          }
+          Value *L = toBool(Vals[Node.LHS - ValsFirst]);
+          Value *R = toBool(Vals[Node.RHS - ValsFirst]);
+          Res = Builder.CreateZExt(Node.Kind == Expr::And ? Builder.CreateAnd(L, R) : Builder.CreateOr(L, R),
+                                   Int32Ty);
+          break;
+        }
+        default:
+          unsupported("This operator");
+          Res = Int32Zero;
+          break;
+        }
       }
-      else
+      return Vals[E - ValsFirst];
+    }
+
+    // Generates Base ^ Exp. A constant exponent is unrolled into the
+    // multiplications of exponentiation by squaring, other exponents call
+    // the gsm.pow helper. Like in the folder, the multiplications wrap around.
+    Value *emitPower(Value *Base, Value *Exp)
+    {
+      auto *C = dyn_cast<ConstantInt>(Exp);
+      if (!C || C->isNegative())
+        return Builder.CreateCall(getPowFunction(), {Base, Exp});
+      Value *Result = nullptr;
+      for (uint64_t E = C->getZExtValue(); E; E >>= 1)
       {
-        // If the factor is a literal, convert it to an integer and create a constant.
-        int intval;
-        Node.getVal().getAsInteger(10, intval);
-        V = ConstantInt::get(Int32Ty, intval, true);
+        if (E & 1)
+          Result = Result ? Builder.CreateMul(Result, Base) : Base;
+        if (E > 1)
+          Base = Builder.CreateMul(Base, Base);
       }
-    };
+      return Result ? Result : ConstantInt::get(Int32Ty, 1);
+    }
 
-    virtual void visit(BinaryOp &Node) override
+    // Returns the helper computing x ^ n by squaring, generating it into the
+    // module on first use. It is internal, so the optimizer inlines it and
+    // removes it when nothing calls it anymore.
+    Function *getPowFunction()
     {
-      // Visit the left-hand side of the binary operation and get its value.
-      Node.getLeft()->accept(*this);
-      Value *Left = V;
+      if (Function *Pow = M->getFunction("gsm.pow"))
+        return Pow;
+      LLVMContext &Ctx = M->getContext();
+      Function *Pow = Function::Create(FunctionType::get(Int32Ty, {Int32Ty, Int32Ty}, false),
+                                       GlobalValue::InternalLinkage, "gsm.pow", M);
+      Pow->setDoesNotAccessMemory();
+      Pow->setDoesNotThrow();
+      Pow->setWillReturn();
+      Value *X = Pow->getArg(0), *N = Pow->getArg(1);
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Pow);
+      BasicBlock *Negative = BasicBlock::Create(Ctx, "negative", Pow);
+      BasicBlock *Header = BasicBlock::Create(Ctx, "loop.header", Pow);
+      BasicBlock *Body = BasicBlock::Create(Ctx, "loop.body", Pow);
+      BasicBlock *Exit = BasicBlock::Create(Ctx, "loop.exit", Pow);
+      IRBuilder<> B(Entry);
+      B.CreateCondBr(B.CreateICmpSLT(N, Int32Zero), Negative, Header);
+
+      // 1 / x ^ -n, truncated toward zero, is 0 unless x is 1 or -1.
+      B.SetInsertPoint(Negative);
+      Value *One = ConstantInt::get(Int32Ty, 1), *MinusOne = ConstantInt::get(Int32Ty, -1, true);
+      Value *Odd = B.CreateTrunc(N, B.getInt1Ty());
+      B.CreateRet(B.CreateSelect(B.CreateICmpEQ(X, MinusOne), B.CreateSelect(Odd, MinusOne, One),
+                                 B.CreateZExt(B.CreateICmpEQ(X, One), Int32Ty)));
 
-      // Visit the right-hand side of the binary operation and get its value.
-      Node.getRight()->accept(*this);
-      Value *Right = V;
+      // Multiply the result by the squares of x for the bits set in n.
+      B.SetInsertPoint(Header);
+      PHINode *Result = B.CreatePHI(Int32Ty, 2, "result");
+      PHINode *Square = B.CreatePHI(Int32Ty, 2, "square");
+      PHINode *Bits = B.CreatePHI(Int32Ty, 2, "bits");
+      B.CreateCondBr(B.CreateICmpEQ(Bits, Int32Zero), Exit, Body);
+      B.SetInsertPoint(Body);
+      Value *Bit = B.CreateTrunc(Bits, B.getInt1Ty());
+      Value *NextResult = B.CreateSelect(Bit, B.CreateMul(Result, Square), Result);
+      Value *NextSquare = B.CreateMul(Square, Square);
+      Value *NextBits = B.CreateLShr(Bits, 1);
+      B.CreateBr(Header);
+      Result->addIncoming(One, Entry);
+      Result->addIncoming(NextResult, Body);
+      Square->addIncoming(X, Entry);
+      Square->addIncoming(NextSquare, Body);
+      Bits->addIncoming(N, Entry);
+      Bits->addIncoming(NextBits, Body);
+      B.SetInsertPoint(Exit);
+      B.CreateRet(Result);
+      return Pow;
+    }
 
-      // Perform the binary operation based on the operator type and create the corresponding instruction.
-      switch (Node.getOperator())
+    // Turns the value of an expression into an i1 truth value. The value of
+    // a comparison is widened from i1, and the widening is undone here.
+    Value *toBool(Value *V)
+    {
+      if (auto *Ext = dyn_cast<ZExtInst>(V))
+        if (Ext->getSrcTy()->isIntegerTy(1))
+        {
+          Value *Bool = Ext->getOperand(0);
+          if (Ext->use_empty())
+            Ext->eraseFromParent();
+          return Bool;
+        }
+      return Builder.CreateICmpNE(V, Int32Zero);
+    }
+
+    // Counts a run of arm Arm in an instrumented program.
+    void countArm(unsigned Arm)
+    {
+      if (!Counters)
+        return;
+      Value *Counter = Builder.CreateConstGEP2_32(Counters->getValueType(), Counters, 0, Arm);
+      Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(Int64Ty, Counter), ConstantInt::get(Int64Ty, 1)),
+                          Counter);
+    }
+
+    // Returns the branch weights of the test of arm Arm, which is taken
+    // against falling through to the arms from Arm + 1 to Last, or null
+    // without a profile.
+    MDNode *getArmWeights(unsigned Arm, unsigned Last)
+    {
+      if (Profile.empty())
+        return nullptr;
+      uint64_t Taken = Profile[Arm], NotTaken = 0;
+      for (unsigned I = Arm + 1; I <= Last; ++I)
+        NotTaken += Profile[I];
+      // Branch weights are 32-bit, and none of them should be 0.
+      uint64_t Scale = std::max(Taken, NotTaken) / UINT32_MAX + 1;
+      return MDBuilder(M->getContext()).createBranchWeights(uint32_t(Taken / Scale + 1), uint32_t(NotTaken / Scale + 1));
+    }
+
+    // Tests if the profile shows that one arm is taken so often that a
+    // branch predicts it well, so branching beats evaluating all arms. The
+    // threshold is the default of LLVM for predictable branches.
+    bool isPredictable(unsigned First, unsigned Last)
+    {
+      if (Profile.empty())
+        return false;
+      uint64_t Total = 0, Max = 0;
+      for (unsigned I = First; I <= Last; ++I)
       {
-      case BinaryOp::Plus:
-        V = Builder.CreateNSWAdd(Left, Right);
-        break;
-      case BinaryOp::Minus:
-        V = Builder.CreateNSWSub(Left, Right);
-        break;
-      case BinaryOp::Mul:
-        V = Builder.CreateNSWMul(Left, Right);
-        break;
-      case BinaryOp::Div:
-        V = Builder.CreateSDiv(Left, Right);
-        break;
+        Total += Profile[I];
+        Max = std::max(Max, Profile[I]);
+      }
+      return Total && Max * 100 >= Total * 99;
+    }
+
+    // Tests if a divisor cannot be 0, or -1 where the division overflows.
+    bool isSafeDivisor(ExprId E)
+    {
+      const Expr &Node = (*Exprs)[E];
+      return Node.Kind == Expr::Number && Node.getValue() != 0 && Node.getValue() != -1;
+    }
+
+    // Tests if an arm of an if statement is a single assignment to Var that
+    // may be evaluated even when the arm is not taken, i.e. it cannot trap.
+    bool isSpeculatable(ArrayRef<AssignNode *> Arm, SymbolId Var)
+    {
+      if (Arm.size() != 1 || Arm[0]->getSymbol() != Var)
+        return false;
+      ExprId E = Arm[0]->getExpr();
+      if ((Arm[0]->getOp() == AssignNode::DIVIDE_EQUAL || Arm[0]->getOp() == AssignNode::MOD_EQUAL) &&
+          !isSafeDivisor(E))
+        return false;
+      return getSpeculationCost(E) != Unsafe;
+    }
+
+    // Creates a block of the statement being generated.
+    BasicBlock *createBlock(const Twine &Name)
+    {
+      return BasicBlock::Create(M->getContext(), Name, MainFn, InsertBefore);
+    }
+
+    // Returns a new loop ID with the hints for the loop passes. The parser
+    // rejects empty blocks, so every loop body assigns a variable and calls
+    // the runtime to write its value, also with --buffer-output. A loop thus
+    // either terminates or keeps writing output: it makes progress.
+    // Vectorization is not requested, as the vectorizer cannot widen these
+    // calls and forcing it would only warn.
+    MDNode *createLoopID()
+    {
+      LLVMContext &Ctx = M->getContext();
+      Metadata *Ops[] = {nullptr, MDNode::get(Ctx, {MDString::get(Ctx, "llvm.loop.mustprogress")})};
+      // A loop ID is distinct and refers to itself.
+      MDNode *LoopID = MDNode::getDistinct(Ctx, Ops);
+      LoopID->replaceOperandWith(0, LoopID);
+      return LoopID;
+    }
+
+    // Visit function for the root node in the AST.
+    virtual void visit(GrammerNode &Node) override
+    {
+      Exprs = &Node.getContext().getExprs();
+
+      // Iterate over the statements and visit each of them.
+      for (auto I = Node.statements.begin(), E = Node.statements.end(); I != E; ++I)
+      {
+        (*I)->accept(*this);
       }
     };
 
-    virtual void visit(Declaration &Node) override
+    // Generates the value an assignment stores.
+    Value *emitAssignedValue(AssignNode &Node)
     {
-      Value *val = nullptr;
+      // Generate the right-hand side of the assignment and get its value.
+      Value *val = emit(Node.getExpr());
 
-      if (Node.getExpr())
+      // Combine the value with the old one for the compound assignments.
+      if (Node.getOp() != AssignNode::EQUAL)
       {
-        // If there is an expression provided, visit it and get its value.
-        Node.getExpr()->accept(*this);
-        val = V;
+        Value *Old = Builder.CreateLoad(Int32Ty, getVariable(Node.getSymbol()));
+        switch (Node.getOp())
+        {
+        case AssignNode::PLUS_EQUAL:
+          val = Builder.CreateNSWAdd(Old, val);
+          break;
+        case AssignNode::MINUS_EQUAL:
+          val = Builder.CreateNSWSub(Old, val);
+          break;
+        case AssignNode::MULT_EQUAL:
+          val = Builder.CreateNSWMul(Old, val);
+          break;
+        case AssignNode::DIVIDE_EQUAL:
+          val = Builder.CreateSDiv(Old, val);
+          break;
+        case AssignNode::MOD_EQUAL:
+          val = Builder.CreateSRem(Old, val);
+          break;
+        default:
+          break;
+        }
       }
+      return val;
+    }
+
+    // Stores the value of an assignment and reports it to the runtime.
+    void storeAndWrite(SymbolId Var, Value *val)
+    {
+      // Create a store instruction to assign the value to the variable.
+      Builder.CreateStore(val, getVariable(Var));
+
+      // Create a call instruction to invoke the "gsm_write" function with the value.
+      Builder.CreateCall(getRuntimeFunction(BufferOutput ? RtWriteBuffered : RtWrite), {val});
+    }
 
+    virtual void visit(AssignNode &Node) override
+    {
+      storeAndWrite(Node.getSymbol(), emitAssignedValue(Node));
+    };
+
+    virtual void visit(DecNode &Node) override
+    {
       // Iterate over the variables declared in the declaration statement.
-      for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+      for (size_t I = 0, E = Node.identifiers.size(); I != E; ++I)
       {
-        StringRef Var = *I;
+        // Generate the initial value of the variable.
+        Value *val = emit(Node.expressions[I]);
+
+        // Get the memory allocated for the variable.
+        AllocaInst *Alloca = getVariable(Node.symbols[I]);
+
+        // Store the initial value in the variable's memory location.
+        Builder.CreateStore(val, Alloca);
+      }
+    };
 
-        // Create an alloca instruction to allocate memory for the variable.
-        nameMap[Var] = Builder.CreateAlloca(Int32Ty);
+    // Generates an if statement. The conditions are tested one after the
+    // other, each one branching to its arm when it holds. When every arm,
+    // including an else part, is a single assignment to the same variable
+    // that cannot trap, and no condition after the first one can trap, all
+    // arms and conditions are evaluated instead and the value is
+    // picked with selects, so there is no branch to mispredict; unless a
+    // profile shows that the branches are predictable. Instrumented
+    // programs always branch to count the arms.
+    virtual void visit(ConditionNode &Node) override
+    {
+      SmallVector<ExprId, 4> Conds = {Node.ifPart->condition};
+      SmallVector<ArrayRef<AssignNode *>, 4> Arms = {Node.ifPart->assigns};
+      for (ElifPartNode *Elif : Node.elifParts)
+      {
+        Conds.push_back(Elif->condition);
+        Arms.push_back(Elif->assigns);
+      }
+      ArrayRef<AssignNode *> Else = Node.elseParts ? Node.elseParts->assigns : None;
+      unsigned FirstArm = NumArms, LastArm = NumArms + Conds.size();
+      NumArms = LastArm + 1;
 
-        // Store the initial value (if any) in the variable's memory location.
-        if (val != nullptr)
+      // The first condition is always evaluated, the later ones only when
+      // the conditions before them do not hold, so those must not trap.
+      SymbolId Var = Arms[0].size() == 1 ? Arms[0][0]->getSymbol() : 0;
+      bool Select = !Counters && Arms[0].size() == 1 && !isPredictable(FirstArm, LastArm) && isSpeculatable(Else, Var) &&
+                    llvm::all_of(Arms, [&](ArrayRef<AssignNode *> Arm) { return isSpeculatable(Arm, Var); }) &&
+                    llvm::all_of(makeArrayRef(Conds).drop_front(),
+                                 [&](ExprId Cond) { return getSpeculationCost(Cond) != Unsafe; });
+      if (Select)
+      {
+        SmallVector<Value *, 4> CondVals, ArmVals;
+        for (size_t I = 0, E = Conds.size(); I != E; ++I)
+        {
+          CondVals.push_back(toBool(emit(Conds[I])));
+          ArmVals.push_back(emitAssignedValue(*Arms[I][0]));
+        }
+        Value *Result = emitAssignedValue(*Else[0]);
+        for (size_t I = Conds.size(); I-- != 0;)
         {
-          Builder.CreateStore(val, nameMap[Var]);
+          Result = Builder.CreateSelect(CondVals[I], ArmVals[I], Result);
+          if (MDNode *Weights = getArmWeights(FirstArm + I, LastArm))
+            if (auto *SI = dyn_cast<SelectInst>(Result))
+              SI->setMetadata(LLVMContext::MD_prof, Weights);
         }
+        storeAndWrite(Var, Result);
+        return;
       }
+
+      // The end block is added to the function last, so the blocks of the
+      // statement stay in order.
+      BasicBlock *End = BasicBlock::Create(M->getContext(), "if.end");
+      for (size_t I = 0, E = Conds.size(); I != E; ++I)
+      {
+        Value *Cond = toBool(emit(Conds[I]));
+        BasicBlock *Then = createBlock("if.then");
+        BasicBlock *Next = I + 1 != E                     ? createBlock("if.elif")
+                           : !Else.empty() || Counters ? createBlock("if.else")
+                                                          : End;
+        BranchInst *Br = Builder.CreateCondBr(Cond, Then, Next);
+        if (MDNode *Weights = getArmWeights(FirstArm + I, LastArm))
+          Br->setMetadata(LLVMContext::MD_prof, Weights);
+
+        Builder.SetInsertPoint(Then);
+        countArm(FirstArm + I);
+        for (AssignNode *A : Arms[I])
+          A->accept(*this);
+        Builder.CreateBr(End);
+        Builder.SetInsertPoint(Next);
+      }
+      if (Builder.GetInsertBlock() != End)
+      {
+        countArm(LastArm);
+        for (AssignNode *A : Else)
+          A->accept(*this);
+        Builder.CreateBr(End);
+      }
+      End->insertInto(MainFn, InsertBefore);
+      Builder.SetInsertPoint(End);
+    };
+
+    // Generates a loop in the canonical form the loop passes expect: the
+    // current block becomes the preheader and branches to the header, which
+    // tests the condition. The body ends in a dedicated latch, the only
+    // block branching back to the header, and the loop leaves to a single
+    // exit block that has no other predecessor.
+    virtual void visit(LoopNode &Node) override
+    {
+      // The blocks are created in the order they are generated in, since a
+      // short-circuit condition adds blocks of its own.
+      BasicBlock *Header = createBlock("loop.header");
+      BasicBlock *Exit = BasicBlock::Create(M->getContext(), "loop.exit");
+      Builder.CreateBr(Header);
+      Builder.SetInsertPoint(Header);
+      Value *Cond = toBool(emit(Node.condition));
+      BasicBlock *Body = createBlock("loop.body");
+      Builder.CreateCondBr(Cond, Body, Exit);
+
+      Builder.SetInsertPoint(Body);
+      for (AssignNode *A : Node.assigns)
+        A->accept(*this);
+      BasicBlock *Latch = createBlock("loop.latch");
+      Builder.CreateBr(Latch);
+
+      Builder.SetInsertPoint(Latch);
+      Builder.CreateBr(Header)->setMetadata(LLVMContext::MD_loop, createLoopID());
+
+      Exit->insertInto(MainFn, InsertBefore);
+      Builder.SetInsertPoint(Exit);
     };
   };
 }; // namespace
 
-void CodeGen::compile(AST *Tree)
+namespace
 {
-  // Create an LLVM context and a module.
-  LLVMContext Ctx;
-  Module *M = new Module("calc.expr", Ctx);
+  // Creates a target machine for the host so the cost models of the
+  // optimizer, e.g. the vectorizers, see the real CPU.
+  std::unique_ptr<TargetMachine> createTargetMachine(unsigned OptLevel)
+  {
+    std::string Triple = sys::getDefaultTargetTriple();
+    std::string Error;
+    const Target *TheTarget = TargetRegistry::lookupTarget(Triple, Error);
+    if (!TheTarget)
+    {
+      errs() << "Cannot find target: " << Error << "\n";
+      return nullptr;
+    }
+
+    SubtargetFeatures Features;
+    StringMap<bool> HostFeatures;
+    if (sys::getHostCPUFeatures(HostFeatures))
+      for (auto &F : HostFeatures)
+        Features.AddFeature(F.first(), F.second);
+
+    CodeGenOpt::Level CGLevel = OptLevel == 0   ? CodeGenOpt::None
+                                : OptLevel == 1 ? CodeGenOpt::Less
+                                : OptLevel == 2 ? CodeGenOpt::Default
+                                                : CodeGenOpt::Aggressive;
+    return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+        Triple, sys::getHostCPUName(), Features.getString(), TargetOptions(),
+        Reloc::PIC_, None, CGLevel));
+  }
+}
+
+CodeGen::CodeGen(unsigned OptLevel)
+    : OptLevel(OptLevel), TM(createTargetMachine(OptLevel)), BufferOutput(false),
+      Report(nullptr)
+{
+}
+
+bool CodeGen::setProfileUse(StringRef File)
+{
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(File);
+  if (!Buf)
+  {
+    errs() << "Cannot read " << File << ": " << Buf.getError().message() << "\n";
+    return true;
+  }
+
+  // The file holds a header line, the number of counts and the counts.
+  SmallVector<StringRef, 0> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n', -1, false);
+  unsigned long long Count;
+  if (Lines.size() < 2 || Lines[0] != "gsm-profile" || getAsUnsignedInteger(Lines[1], 10, Count) ||
+      Lines.size() != Count + 2)
+  {
+    errs() << File << " is not a profile\n";
+    return true;
+  }
+  std::vector<uint64_t> Counts(Count);
+  for (size_t I = 0; I != Counts.size(); ++I)
+    if (getAsUnsignedInteger(Lines[I + 2], 10, Count))
+    {
+      errs() << File << " is not a profile\n";
+      return true;
+    }
+    else
+      Counts[I] = Count;
+  Profile = std::move(Counts);
+  return false;
+}
+
+std::unique_ptr<Module> CodeGen::generate(AST *Tree, LLVMContext &Ctx)
+{
+  auto M = std::make_unique<Module>("calc.expr", Ctx);
 
   // Create an instance of the ToIRVisitor and run it on the AST to generate LLVM IR.
-  ToIRVisitor ToIR(M);
-  ToIR.run(Tree);
+  ToIRVisitor ToIR(M.get());
+  if (!ProfileFile.empty())
+    ToIR.instrument(ProfileFile);
+  ToIR.useProfile(Profile);
+  if (BufferOutput)
+    ToIR.bufferOutput();
+  {
+    PhaseReport::Region Time(Report, "irgen");
+    if (ToIR.run(Tree))
+      return nullptr;
+  }
+  if (Report)
+    Report->count("irgen", "instructions", M->getInstructionCount());
+
+  // Run the optimization pipeline before the module is printed or executed.
+  if (TM)
+  {
+    M->setTargetTriple(TM->getTargetTriple().str());
+    M->setDataLayout(TM->createDataLayout());
+  }
+  {
+    PhaseReport::Region Time(Report, "optimize");
+    Optimizer Opt(TM.get(), OptLevel);
+    Opt.optimize(*M);
+  }
+  if (Report)
+    Report->count("optimize", "instructions", M->getInstructionCount());
+  return M;
+}
+
+bool CodeGen::emit(Module &M, StringRef OutputFile, EmitKind Kind)
+{
+  std::error_code EC;
+  sys::fs::OpenFlags Flags = (Kind == EmitLL || Kind == EmitAsm) ? sys::fs::OF_Text : sys::fs::OF_None;
+  ToolOutputFile Out(OutputFile, EC, Flags);
+  if (EC)
+  {
+    errs() << "Cannot open " << OutputFile << ": " << EC.message() << "\n";
+    return true;
+  }
+
+  switch (Kind)
+  {
+  case EmitLL:
+    M.print(Out.os(), nullptr);
+    break;
+  case EmitBC:
+    WriteBitcodeToFile(M, Out.os());
+    break;
+  case EmitAsm:
+  case EmitObj:
+  case EmitExe:
+  {
+    if (!TM)
+      return true;
+    // Run the code generator directly on the in-memory module.
+    legacy::PassManager PM;
+    CodeGenFileType FileType = Kind == EmitAsm ? CGFT_AssemblyFile : CGFT_ObjectFile;
+    if (TM->addPassesToEmitFile(PM, Out.os(), nullptr, FileType))
+    {
+      errs() << "The target cannot emit this file type\n";
+      return true;
+    }
+    PM.run(M);
+    break;
+  }
+  }
+
+  Out.keep();
+  return false;
+}
+
+bool CodeGen::link(StringRef ObjectFile, StringRef OutputFile)
+{
+  if (RuntimeLib.empty())
+  {
+    errs() << "No runtime library to link against\n";
+    return true;
+  }
+  ErrorOr<std::string> CC = sys::findProgramByName("cc");
+  if (!CC)
+  {
+    errs() << "Cannot find the system linker driver cc\n";
+    return true;
+  }
+
+  StringRef Args[] = {*CC, "-o", OutputFile, ObjectFile, RuntimeLib};
+  std::string ErrMsg;
+  if (sys::ExecuteAndWait(*CC, Args, None, {}, 0, 0, &ErrMsg) != 0)
+  {
+    errs() << "Linking " << OutputFile << " failed" << (ErrMsg.empty() ? "" : ": ") << ErrMsg << "\n";
+    return true;
+  }
+  return false;
+}
+
+std::string CodeGen::getTargetID()
+{
+  if (!TM)
+    return "";
+  return (TM->getTargetTriple().str() + "/" + TM->getTargetCPU() + "/" +
+          TM->getTargetFeatureString()).str();
+}
+
+bool CodeGen::compile(AST *Tree, StringRef OutputFile, EmitKind Kind)
+{
+  // Create an LLVM context and generate the module.
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M = generate(Tree, Ctx);
+  if (!M)
+    return true;
+
+  PhaseReport::Region Time(Report, "emit");
+  if (Kind != EmitExe)
+    return emit(*M, OutputFile, Kind);
+
+  // Write the object to a temporary file and link it with the runtime.
+  SmallString<128> ObjectFile;
+  if (std::error_code EC = sys::fs::createTemporaryFile("gsm", "o", ObjectFile))
+  {
+    errs() << "Cannot create temporary file: " << EC.message() << "\n";
+    return true;
+  }
+  FileRemover RemoveObject(ObjectFile);
+  if (emit(*M, ObjectFile, EmitObj))
+    return true;
+  return link(ObjectFile, OutputFile);
+}
+
+bool CodeGen::run(AST *Tree, int &Result)
+{
+  TimeRecord Start = TimeRecord::getCurrentTime(true);
+
+  // The JIT takes ownership of the context together with the module.
+  auto Ctx = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> M = generate(Tree, *Ctx);
+  if (!M)
+    return true;
+  double IRTime = (TimeRecord::getCurrentTime(false).getWallTime() - Start.getWallTime()) * 1000.0;
+
+  JIT Engine;
+  {
+    PhaseReport::Region Time(Report, "jit");
+    if (Engine.run(std::move(M), std::move(Ctx), Result))
+      return true;
+  }
+  if (Report)
+  {
+    Report->count("jit", "compile_us", uint64_t(Engine.getCompileTime() * 1000));
+    Report->count("jit", "execute_us", uint64_t(Engine.getExecuteTime() * 1000));
+  }
+
+  // Flush the program output before reporting the latency.
+  outs().flush();
+  fflush(stdout);
+  errs() << format("compile: %.3f ms (IR %.3f ms, JIT %.3f ms), execute: %.3f ms\n",
+                   IRTime + Engine.getCompileTime(), IRTime,
+                   Engine.getCompileTime(), Engine.getExecuteTime());
+  return false;
+}
+
+struct IncrementalCodeGen::Impl
+{
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M;
+  ToIRVisitor ToIR;
+  BasicBlock *Entry; // holds the allocas and branches to the first statement
+  BasicBlock *Exit;  // returns from main after the last statement
+
+  Impl() : M(std::make_unique<Module>("calc.expr", Ctx)), ToIR(M.get())
+  {
+    Entry = ToIR.createMain();
+    Exit = BasicBlock::Create(Ctx, "exit", Entry->getParent());
+    BranchInst::Create(Exit, Entry);
+    ReturnInst::Create(Ctx, ConstantInt::get(Type::getInt32Ty(Ctx), 0), Exit);
+  }
+};
+
+IncrementalCodeGen::IncrementalCodeGen() : I(std::make_unique<Impl>()) {}
+
+IncrementalCodeGen::~IncrementalCodeGen() = default;
+
+Module &IncrementalCodeGen::getModule() { return *I->M; }
+
+bool IncrementalCodeGen::insert(Grammer *Stmt, ExprPool &Exprs, BasicBlock *After,
+                                BasicBlock *Before, Range &Code)
+{
+  BasicBlock *Pred = After ? After : I->Entry;
+  BasicBlock *Succ = Before ? Before : I->Exit;
+  if (I->ToIR.emitStatement(Stmt, Exprs, Succ, Code.First, Code.Last))
+  {
+    // Leave the function as it was.
+    erase(Code, After, Before);
+    return true;
+  }
+  BranchInst::Create(Succ, Code.Last);
+  Pred->getTerminator()->setSuccessor(0, Code.First);
+  return false;
+}
+
+void IncrementalCodeGen::erase(Range Code, BasicBlock *After, BasicBlock *Before)
+{
+  BasicBlock *Pred = After ? After : I->Entry;
+  BasicBlock *Succ = Before ? Before : I->Exit;
+  Pred->getTerminator()->setSuccessor(0, Succ);
+
+  // The blocks of a statement are adjacent in the function. References
+  // between them are dropped first, as they may refer to each other.
+  SmallVector<BasicBlock *, 4> Blocks;
+  for (auto BB = Code.First->getIterator();; ++BB)
+  {
+    Blocks.push_back(&*BB);
+    if (&*BB == Code.Last)
+      break;
+  }
+  SmallPtrSet<Function *, 4> Callees;
+  for (BasicBlock *BB : Blocks)
+  {
+    for (Instruction &Inst : *BB)
+      if (auto *Call = dyn_cast<CallInst>(&Inst))
+        if (Function *Callee = Call->getCalledFunction())
+          Callees.insert(Callee);
+    BB->dropAllReferences();
+  }
+  for (BasicBlock *BB : Blocks)
+    BB->eraseFromParent();
 
-  // Print the generated module to the standard output.
-  M->print(outs(), nullptr);
+  // Remove the runtime functions and helpers nothing calls anymore.
+  for (Function *Callee : Callees)
+    if (Callee->use_empty())
+      Callee->eraseFromParent();
 }
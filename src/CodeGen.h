@@ -2,11 +2,113 @@
 #define CODEGEN_H
 
 #include "AST.h"
+#include "PhaseReport.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <string>
+#include <vector>
 
 class CodeGen
 {
 public:
- void compile(AST *Tree);
+ // The kinds of output files compile() can write.
+ enum EmitKind
+ {
+  EmitLL,  // textual LLVM IR
+  EmitBC,  // LLVM bitcode
+  EmitAsm, // native assembly
+  EmitObj, // native object file
+  EmitExe  // executable linked against the runtime library
+ };
 
+private:
+ unsigned OptLevel;                      // optimization level of the pass pipeline, 0 to 3
+ std::unique_ptr<llvm::TargetMachine> TM; // host target, null if it is not available
+ std::string RuntimeLib;                 // archive of rtGSM.c used for EmitExe
+ std::string ProfileFile;                // written by instrumented programs, or empty
+ std::vector<uint64_t> Profile;          // arm counts of the if statements, or empty
+ bool BufferOutput;                      // buffer the output of the program, see setBufferOutput()
+ PhaseReport *Report;                    // receives the times of the phases, or null
+
+ // Writes the module to OutputFile in the given format.
+ bool emit(llvm::Module &M, llvm::StringRef OutputFile, EmitKind Kind);
+
+public:
+ CodeGen(unsigned OptLevel = 0);
+
+ void setRuntimeLib(llvm::StringRef Path) { RuntimeLib = Path.str(); }
+
+ // Makes the generated programs count how often each arm of their if
+ // statements is taken and write the counts to File when they exit.
+ void setProfileGenerate(llvm::StringRef File) { ProfileFile = File.str(); }
+
+ // Reads the counts written by an instrumented program and uses them to
+ // weight the branches of the same program. Returns true if the file cannot
+ // be read.
+ bool setProfileUse(llvm::StringRef File);
+
+ // Makes the generated programs collect their output in a buffer of the
+ // runtime instead of printing every assignment, and write it when they
+ // exit or read input.
+ void setBufferOutput(bool Buffer) { BufferOutput = Buffer; }
+
+ // Times the code generation phases into Report, which may be null.
+ void setReport(PhaseReport *R) { Report = R; }
+
+ // Builds the optimized LLVM module for the AST inside the given context, or
+ // returns null if the AST cannot be compiled.
+ std::unique_ptr<llvm::Module> generate(AST *Tree, llvm::LLVMContext &Ctx);
+
+ // Writes the code for the AST to OutputFile, "-" being the standard output.
+ // Returns true if an error occurred.
+ bool compile(AST *Tree, llvm::StringRef OutputFile = "-", EmitKind Kind = EmitLL);
+
+ // Links an object file with the runtime library into an executable.
+ // Returns true if an error occurred.
+ bool link(llvm::StringRef ObjectFile, llvm::StringRef OutputFile);
+
+ // Describes the target the code is generated for: the triple, the CPU and
+ // its features.
+ std::string getTargetID();
+
+ // Executes the AST in-process with the JIT. Returns true if the module
+ // could not be compiled, otherwise stores the exit code of main in Result.
+ bool run(AST *Tree, int &Result);
+};
+
+// Keeps the unoptimized module of a program and updates it one top-level
+// statement at a time, so that an edit regenerates only the statements it
+// touches. Every statement owns a chain of blocks inside main, linked in
+// program order between the entry block and the exit block.
+class IncrementalCodeGen
+{
+ struct Impl;
+ std::unique_ptr<Impl> I;
+
+public:
+ // The blocks of a statement, from the first to the last in the function.
+ struct Range
+ {
+  llvm::BasicBlock *First = nullptr;
+  llvm::BasicBlock *Last = nullptr;
+ };
+
+ IncrementalCodeGen();
+ ~IncrementalCodeGen();
+
+ // Generates Stmt between the last block of the statement After and the
+ // first block of the statement Before, null meaning the start or the end of
+ // the program. Returns true if the statement cannot be generated, otherwise
+ // stores its blocks in Code.
+ bool insert(Grammer *Stmt, ExprPool &Exprs, llvm::BasicBlock *After, llvm::BasicBlock *Before,
+             Range &Code);
+
+ // Removes the blocks of a statement and links After to Before.
+ void erase(Range Code, llvm::BasicBlock *After, llvm::BasicBlock *Before);
+
+ llvm::Module &getModule();
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "CompileCache.h"
+#include "Lexer.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+
+using namespace llvm;
+
+// Bump this when the generated code changes, so old entries are not reused.
+static const char CacheVersion[] = "gsm-cache-2";
+
+std::string CompileCache::getKey(StringRef Source, StringRef Config)
+{
+  SHA1 Hash;
+  Hash.update(CacheVersion);
+  Hash.update(Config);
+
+  // Hash the tokens instead of the text: only the kind of a token matters,
+  // plus the text of identifiers, numbers and unknown characters. Leading
+  // zeros of numbers do not change their value and are skipped.
+  Lexer Lex(Source);
+  Token Tok;
+  do
+  {
+    Lex.next(Tok);
+    uint8_t Kind[2] = {uint8_t(Tok.getKind()), uint8_t(Tok.getKind() >> 8)};
+    Hash.update(makeArrayRef(Kind));
+    StringRef Text;
+    if (Tok.is(Token::number))
+    {
+      Text = Tok.getText().ltrim('0');
+      if (Text.empty())
+        Text = "0";
+    }
+    else if (Tok.isOneOf(Token::ident, Token::unknown))
+      Text = Tok.getText();
+    else
+      continue;
+    // the length keeps "ab" "c" apart from "a" "bc"
+    uint8_t Len[4] = {uint8_t(Text.size()), uint8_t(Text.size() >> 8),
+                      uint8_t(Text.size() >> 16), uint8_t(Text.size() >> 24)};
+    Hash.update(makeArrayRef(Len));
+    Hash.update(Text);
+  } while (!Tok.is(Token::eoi));
+
+  return toHex(Hash.final(), /*LowerCase=*/true);
+}
+
+std::string CompileCache::getPath(StringRef Key)
+{
+  // pruneCache only ever removes files named llvmcache-*
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, "llvmcache-" + Key);
+  return std::string(Path.str());
+}
+
+bool CompileCache::lookup(StringRef Key)
+{
+  int FD;
+  if (sys::fs::openFileForRead(getPath(Key), FD))
+  {
+    ++Misses;
+    return false;
+  }
+  // The eviction goes by the access time, which is not updated on every
+  // file system, so it is set explicitly.
+  sys::fs::setLastAccessAndModificationTime(FD, std::chrono::system_clock::now());
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  ++Hits;
+  return true;
+}
+
+bool CompileCache::createTemporary(SmallVectorImpl<char> &Path)
+{
+  if (std::error_code EC = sys::fs::create_directories(Dir))
+  {
+    errs() << "Cannot create cache directory " << Dir << ": " << EC.message() << "\n";
+    return true;
+  }
+  SmallString<128> Model(Dir);
+  sys::path::append(Model, "tmp-%%%%%%%%%%%%");
+  int FD;
+  if (std::error_code EC = sys::fs::createUniqueFile(Model, FD, Path))
+  {
+    errs() << "Cannot create file in cache directory " << Dir << ": " << EC.message() << "\n";
+    return true;
+  }
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  return false;
+}
+
+bool CompileCache::insert(StringRef Key, StringRef TempFile)
+{
+  // Renaming is atomic, so other processes never see a partial entry.
+  if (std::error_code EC = sys::fs::rename(TempFile, getPath(Key)))
+  {
+    errs() << "Cannot add " << TempFile << " to the cache: " << EC.message() << "\n";
+    sys::fs::remove(TempFile);
+    return true;
+  }
+
+  // Remove the least recently used entries over the size limit. Entries do
+  // not expire otherwise.
+  CachePruningPolicy Policy;
+  Policy.Interval = std::chrono::seconds(0);
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizeBytes = MaxSize;
+  pruneCache(Dir, Policy);
+  return false;
+}
+
+void CompileCache::printStats(raw_ostream &OS)
+{
+  unsigned Total = Hits + Misses;
+  OS << format("cache: %u hits, %u misses (%.1f%% hit rate)\n", unsigned(Hits),
+               unsigned(Misses), Total ? 100.0 * Hits / Total : 0.0);
+}
@@ -0,0 +1,50 @@
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// An on-disk cache of compiled programs, shared by all gsm processes using
+// the same directory. Entries are addressed by a hash of the token stream of
+// the program, so changes of whitespace do not miss, together with everything
+// else the output depends on. When the directory grows over its size limit,
+// the least recently used entries are removed.
+class CompileCache
+{
+  std::string Dir;              // directory holding the entries
+  uint64_t MaxSize;             // size limit of the directory in bytes
+  std::atomic<unsigned> Hits;   // lookups that found an entry
+  std::atomic<unsigned> Misses; // lookups that did not
+
+public:
+  CompileCache(llvm::StringRef Dir, uint64_t MaxSize)
+      : Dir(Dir.str()), MaxSize(MaxSize), Hits(0), Misses(0) {}
+
+  // Returns the key of a program. Config names everything besides the
+  // source that the output depends on, e.g. the output kind, the
+  // optimization level and the target.
+  static std::string getKey(llvm::StringRef Source, llvm::StringRef Config);
+
+  // Returns the file of the entry for Key.
+  std::string getPath(llvm::StringRef Key);
+
+  // Tests if there is an entry for Key and marks it as recently used.
+  bool lookup(llvm::StringRef Key);
+
+  // Creates a temporary file in the cache directory for the output of a
+  // compilation, to be added with insert(). Returns true on error.
+  bool createTemporary(llvm::SmallVectorImpl<char> &Path);
+
+  // Moves the temporary file into the cache as the entry for Key, then
+  // evicts entries if the cache is too large. Returns true on error.
+  bool insert(llvm::StringRef Key, llvm::StringRef TempFile);
+
+  // Prints the number of hits and misses.
+  void printStats(llvm::raw_ostream &OS);
+};
+
+#endif
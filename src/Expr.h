@@ -0,0 +1,130 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <vector>
+
+// Index of an expression node inside an ExprPool.
+typedef uint32_t ExprId;
+
+// Dense number of an identifier, see ExprPool::intern(). Passes keep the
+// state of each variable in a vector indexed by it.
+typedef uint32_t SymbolId;
+
+// A node of the flat expression encoding. Instead of a chain of node classes
+// with child pointers, every expression is a run of these 12-byte records in
+// one array, and operands are referenced by their 32-bit index.
+struct Expr
+{
+  enum ExprKind : uint8_t
+  {
+    Number, // integer literal, LHS holds the value
+    Ident,  // variable, LHS holds its symbol
+
+    // and, or
+    And,
+    Or,
+
+    // <, >, <=, >=, ==, !=
+    LessThan,
+    GreaterThan,
+    LessThanEqual,
+    GreaterThanEqual,
+    Equal,
+    NotEqual,
+
+    // +, -, *, /, %, ^
+    Plus,
+    Minus,
+    Mul,
+    Div,
+    Mod,
+    Power
+  };
+
+  ExprKind Kind;
+  uint32_t LHS; // left operand, or the payload of a leaf
+  uint32_t RHS; // right operand, unused for leaves
+
+  bool isLeaf() const { return Kind == Number || Kind == Ident; }
+  int32_t getValue() const { return (int32_t)LHS; }
+};
+
+// Owns the expression nodes of a compilation. Operands are always appended
+// before the node using them, so the subtree of a node N is the contiguous
+// range [first(N), N] and a forward scan over it is a post-order traversal.
+class ExprPool
+{
+  std::vector<Expr> Nodes;              // all expression nodes
+  llvm::StringMap<SymbolId> SymbolIds;  // owns the text of the identifiers
+  std::vector<llvm::StringRef> Symbols; // text of each symbol
+
+  ExprId add(Expr::ExprKind Kind, uint32_t LHS, uint32_t RHS)
+  {
+    Nodes.push_back({Kind, LHS, RHS});
+    return (ExprId)(Nodes.size() - 1);
+  }
+
+public:
+  ExprId number(int32_t Value) { return add(Expr::Number, (uint32_t)Value, 0); }
+
+  ExprId ident(SymbolId Symbol) { return add(Expr::Ident, Symbol, 0); }
+
+  ExprId binary(Expr::ExprKind Kind, ExprId LHS, ExprId RHS) { return add(Kind, LHS, RHS); }
+
+  const Expr &operator[](ExprId Id) const { return Nodes[Id]; }
+  Expr &operator[](ExprId Id) { return Nodes[Id]; }
+
+  // Returns the symbol of an identifier, numbering identifiers in the order
+  // they are first seen. The text is copied, so the symbol and the AST may
+  // outlive the source buffer.
+  SymbolId intern(llvm::StringRef Name)
+  {
+    auto Res = SymbolIds.try_emplace(Name, (SymbolId)Symbols.size());
+    if (Res.second)
+      Symbols.push_back(Res.first->getKey());
+    return Res.first->second;
+  }
+
+  llvm::StringRef getSymbolName(SymbolId Symbol) const { return Symbols[Symbol]; }
+
+  size_t getNumSymbols() const { return Symbols.size(); }
+
+  // Returns the symbol of an Ident node.
+  SymbolId getSymbol(ExprId Id) const { return Nodes[Id].LHS; }
+
+  // Returns the identifier of an Ident node.
+  llvm::StringRef getName(ExprId Id) const { return Symbols[Nodes[Id].LHS]; }
+
+  // Returns the first node of the subtree rooted at Id.
+  ExprId first(ExprId Id) const
+  {
+    while (!Nodes[Id].isLeaf())
+      Id = Nodes[Id].LHS;
+    return Id;
+  }
+
+  size_t size() const { return Nodes.size(); }
+
+  // Returns the memory held by the nodes and the symbol table.
+  size_t getBytesAllocated() const
+  {
+    size_t Bytes = Nodes.capacity() * sizeof(Expr) + Symbols.capacity() * sizeof(llvm::StringRef) +
+                   SymbolIds.getNumBuckets() * sizeof(void *);
+    for (llvm::StringRef Name : Symbols)
+      Bytes += sizeof(llvm::StringMapEntry<SymbolId>) + Name.size() + 1;
+    return Bytes;
+  }
+
+  // Releases all nodes and symbols.
+  void clear()
+  {
+    std::vector<Expr>().swap(Nodes);
+    std::vector<llvm::StringRef>().swap(Symbols);
+    SymbolIds.clear();
+  }
+};
+
+#endif
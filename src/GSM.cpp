@@ -1,53 +1,497 @@
 #include "CodeGen.h"
+#include "CompileCache.h"
 #include "Parser.h"
+#include "PhaseReport.h"
 #include "Sema.h"
+#include "Server.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 
-// Define a command-line option for specifying the input expression.
+// Define a command-line option for specifying the input files, '-' being the standard input.
+static llvm::cl::list<std::string>
+    InputFiles(llvm::cl::Positional,
+               llvm::cl::desc("<input files>"));
+
+// Define a command-line option for the number of files compiled in parallel.
+static llvm::cl::opt<unsigned>
+    Jobs("j",
+         llvm::cl::desc("Number of input files compiled in parallel (default: all cores)"),
+         llvm::cl::value_desc("N"),
+         llvm::cl::init(0));
+
+// Define a command-line option for passing the program text directly.
 static llvm::cl::opt<std::string>
-    Input(llvm::cl::Positional,
-          llvm::cl::desc("<input expression>"),
-          llvm::cl::init(""));
+    Program("e",
+            llvm::cl::desc("Compile the given program text instead of a file"),
+            llvm::cl::value_desc("program"));
 
-// The main function of the Grammer.
-int main(int argc, const char **argv)
+// Define a command-line option for executing the program with the JIT instead of printing IR.
+static llvm::cl::opt<bool>
+    Run("run",
+        llvm::cl::desc("Execute the program in-process with the JIT"),
+        llvm::cl::init(false));
+
+// Define a command-line option for the output file.
+static llvm::cl::opt<std::string>
+    OutputFile("o",
+               llvm::cl::desc("Output file, '-' for the standard output"),
+               llvm::cl::value_desc("filename"),
+               llvm::cl::init("-"));
+
+// Define a command-line option for the kind of output file.
+static llvm::cl::opt<CodeGen::EmitKind>
+    Emit("emit",
+         llvm::cl::desc("Kind of output file:"),
+         llvm::cl::values(clEnumValN(CodeGen::EmitLL, "ll", "Textual LLVM IR (default)"),
+                          clEnumValN(CodeGen::EmitBC, "bc", "LLVM bitcode"),
+                          clEnumValN(CodeGen::EmitAsm, "asm", "Native assembly"),
+                          clEnumValN(CodeGen::EmitObj, "obj", "Native object file"),
+                          clEnumValN(CodeGen::EmitExe, "exe", "Executable linked with the runtime library")),
+         llvm::cl::init(CodeGen::EmitLL));
+
+#ifndef GSM_RUNTIME_LIB
+#define GSM_RUNTIME_LIB ""
+#endif
+
+// Define a command-line option for the runtime archive linked into executables.
+static llvm::cl::opt<std::string>
+    RuntimeLib("runtime-lib",
+               llvm::cl::desc("Runtime library linked with --emit=exe"),
+               llvm::cl::value_desc("archive"),
+               llvm::cl::init(GSM_RUNTIME_LIB));
+
+// Guesses the kind of output file from the extension of the output file name.
+static CodeGen::EmitKind emitKindFor(llvm::StringRef File)
 {
-    // Initialize the LLVM framework.
-    llvm::InitLLVM X(argc, argv);
+    if (File.endswith(".bc"))
+        return CodeGen::EmitBC;
+    if (File.endswith(".s"))
+        return CodeGen::EmitAsm;
+    if (File.endswith(".o"))
+        return CodeGen::EmitObj;
+    return CodeGen::EmitLL;
+}
 
-    // Parse command-line options.
-    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM - the expression compiler\n");
+// Define a command-line option for running as a compile server, see gsmc for the client.
+static llvm::cl::opt<bool>
+    Serve("serve",
+          llvm::cl::desc("Serve compile requests on a Unix domain socket"),
+          llvm::cl::init(false));
+
+// Define a command-line option for the socket of the compile server.
+static llvm::cl::opt<std::string>
+    SocketPath("socket",
+               llvm::cl::desc("Socket of the compile server"),
+               llvm::cl::value_desc("path"),
+               llvm::cl::init(server::getDefaultSocketPath()));
+
+// Define the -O0 to -O3 options for the optimization pipeline.
+enum OptLevel
+{
+    O0,
+    O1,
+    O2,
+    O3
+};
+static llvm::cl::opt<OptLevel>
+    OptimizationLevel(llvm::cl::desc("Optimization level:"),
+                      llvm::cl::values(clEnumVal(O0, "No optimizations (default)"),
+                                       clEnumVal(O1, "Enable basic optimizations"),
+                                       clEnumVal(O2, "Enable default optimizations and vectorization"),
+                                       clEnumVal(O3, "Enable aggressive optimizations")),
+                      llvm::cl::init(O0));
+
+// Define a command-line option for folding constant expressions before code generation.
+static llvm::cl::opt<bool>
+    Fold("fold",
+         llvm::cl::desc("Fold constant expressions and propagate known values (default: on)"),
+         llvm::cl::init(true));
 
-    // Create a lexer object and initialize it with the input expression.
-    Lexer Lex(Input);
+// Define a command-line option for printing how much of the expressions was folded.
+static llvm::cl::opt<bool>
+    FoldStats("fold-stats",
+              llvm::cl::desc("Print the number of expression nodes eliminated by folding"),
+              llvm::cl::init(false));
+
+// Define a command-line option for buffering the output of the program.
+static llvm::cl::opt<bool>
+    BufferOutput("buffer-output",
+                 llvm::cl::desc("Collect the output of the program in a buffer written when it exits"),
+                 llvm::cl::init(false));
+
+// Define a command-line option for instrumenting the if statements of the program.
+static llvm::cl::opt<std::string>
+    ProfileGenerate("profile-generate",
+                    llvm::cl::desc("Count the arms taken by the if statements and write the counts to this file"),
+                    llvm::cl::value_desc("file"));
+
+// Define a command-line option for weighting the branches with an earlier profile.
+static llvm::cl::opt<std::string>
+    ProfileUse("profile-use",
+               llvm::cl::desc("Weight the branches of the if statements with the counts in this file"),
+               llvm::cl::value_desc("file"));
+
+// The formats of the report on the phases of the compilation.
+enum StatsFormat
+{
+    StatsNone,
+    StatsText,
+    StatsJSON
+};
+
+// Define a command-line option for reporting the time, memory and counters of
+// each phase. LLVM already registers --stats for its own statistics.
+static llvm::cl::opt<StatsFormat>
+    Stats("phase-stats",
+          llvm::cl::desc("Report the time, memory and counters of each compilation phase on stderr"),
+          llvm::cl::values(clEnumValN(StatsText, "text", "one line per phase"),
+                           clEnumValN(StatsJSON, "json", "one JSON object per program")),
+          llvm::cl::init(StatsNone));
+
+// Define a command-line option for the text form of the phase report.
+static llvm::cl::opt<bool>
+    TimeReport("time-report",
+               llvm::cl::desc("Same as --phase-stats=text"),
+               llvm::cl::init(false));
+
+// Define a command-line option for the directory of the compilation cache.
+static llvm::cl::opt<std::string>
+    CacheDir("cache-dir",
+             llvm::cl::desc("Reuse the output of earlier compilations stored in this directory"),
+             llvm::cl::value_desc("directory"));
+
+// Define a command-line option for the size limit of the compilation cache.
+static llvm::cl::opt<unsigned>
+    CacheSize("cache-size",
+              llvm::cl::desc("Size limit of the compilation cache in MB"),
+              llvm::cl::init(512));
+
+// Define a command-line option for printing the hits and misses of the cache.
+static llvm::cl::opt<bool>
+    CacheStats("cache-stats",
+               llvm::cl::desc("Print the hits and misses of the compilation cache"),
+               llvm::cl::init(false));
+
+// The compilation cache, null without --cache-dir.
+static std::unique_ptr<CompileCache> Cache;
+
+// Writes the output of a compilation from its cache entry.
+static bool writeCached(CodeGen &CodeGenerator, llvm::StringRef Entry,
+                        llvm::StringRef Output, CodeGen::EmitKind Kind)
+{
+    if (Kind == CodeGen::EmitExe)
+        return CodeGenerator.link(Entry, Output);
+
+    std::error_code EC;
+    if (Output == "-")
+    {
+        llvm::outs().flush();
+        EC = llvm::sys::fs::copy_file(Entry, 1);
+    }
+    else
+        EC = llvm::sys::fs::copy_file(Entry, Output);
+    if (EC)
+    {
+        llvm::errs() << "Cannot write " << Output << ": " << EC.message() << "\n";
+        return true;
+    }
+    return false;
+}
+
+// Runs the whole pipeline on one program. Everything is created here, in
+// particular the LLVMContext and the module, so several programs can be
+// compiled on different threads at the same time. With Execute the program
+// runs in the JIT instead of being written to Output. Returns true if an error
+// occurred; the exit code of the program is stored in Result.
+static bool compileProgram(const llvm::MemoryBuffer &Buffer, llvm::StringRef Output,
+                           CodeGen::EmitKind Kind, bool Execute, unsigned OptLevel,
+                           int &Result)
+{
+    // The phase report is printed on the way out, also when the compilation
+    // fails, as one write so the reports of parallel compilations stay apart.
+    StatsFormat Format = TimeReport && Stats == StatsNone ? StatsText : Stats;
+    std::unique_ptr<PhaseReport> Report;
+    if (Format != StatsNone)
+        Report = std::make_unique<PhaseReport>(Buffer.getBufferIdentifier());
+    struct ReportPrinter
+    {
+        PhaseReport *Report;
+        StatsFormat Format;
+        ~ReportPrinter()
+        {
+            if (!Report)
+                return;
+            std::string Text;
+            llvm::raw_string_ostream OS(Text);
+            if (Format == StatsJSON)
+                Report->printJSON(OS);
+            else
+                Report->print(OS);
+            llvm::errs() << OS.str();
+        }
+    } PrintReport{Report.get(), Format};
+
+    CodeGen CodeGenerator(OptLevel);
+    CodeGenerator.setRuntimeLib(RuntimeLib);
+    CodeGenerator.setReport(Report.get());
+    CodeGenerator.setBufferOutput(BufferOutput);
+    if (!ProfileGenerate.empty())
+        CodeGenerator.setProfileGenerate(ProfileGenerate);
+    if (!ProfileUse.empty() && CodeGenerator.setProfileUse(ProfileUse))
+        return true;
+
+    // Look the program up in the cache before parsing it. Executables are
+    // linked from a cached object file. Profiles are not part of the key, so
+    // compilations with profiles bypass the cache.
+    CodeGen::EmitKind CachedKind = Kind == CodeGen::EmitExe ? CodeGen::EmitObj : Kind;
+    bool UseCache = Cache && !Execute && ProfileGenerate.empty() && ProfileUse.empty();
+    std::string Key;
+    if (UseCache)
+    {
+        std::string Config = std::to_string(CachedKind) + "/O" + std::to_string(OptLevel) +
+                             (Fold ? "/fold" : "") + (BufferOutput ? "/buffer/" : "/") +
+                             CodeGenerator.getTargetID();
+        bool Hit;
+        {
+            PhaseReport::Region Time(Report.get(), "cache");
+            Key = CompileCache::getKey(Buffer.getBuffer(), Config);
+            Hit = Cache->lookup(Key);
+        }
+        if (Report)
+            Report->count("cache", "hit", Hit);
+        if (Hit)
+            return writeCached(CodeGenerator, Cache->getPath(Key), Output, Kind);
+    }
+
+    // Lex the whole input up front, so lexing and parsing are timed apart.
+    Lexer Lex(Buffer);
+    TokenBuffer Tokens;
+    bool LexError;
+    {
+        PhaseReport::Region Time(Report.get(), "lex");
+        LexError = Lex.tokenizeAll(Tokens);
+    }
+    if (LexError)
+    {
+        llvm::errs() << Buffer.getBufferIdentifier() << ": The input is too large\n";
+        return true;
+    }
+    if (Report)
+        Report->count("lex", "tokens", Tokens.size());
 
-    // Create a parser object and initialize it with the lexer.
-    Parser Parser(Lex);
+    // Create the context that owns all AST nodes of this compilation.
+    ASTContext Context;
+
+    // Create a parser object and initialize it with the tokens.
+    Parser Parser(Tokens, Context);
 
     // Parse the input expression and generate an abstract syntax tree (AST).
-    AST *Tree = Parser.parse();
+    AST *Tree;
+    {
+        PhaseReport::Region Time(Report.get(), "parse");
+        Tree = Parser.parse();
+    }
+    if (Report)
+    {
+        Report->count("parse", "ast_nodes", Context.getNumNodes());
+        Report->count("parse", "expr_nodes", Context.getExprs().size());
+        Report->count("parse", "ast_bytes",
+                      Context.getBytesAllocated() + Context.getExprs().getBytesAllocated());
+    }
 
     // Check if parsing was successful or if there were any syntax errors.
     if (!Tree || Parser.hasError())
     {
-        llvm::errs() << "Syntax errors occurred\n";
-        return 1;
+        // The parser recovered from the errors, so the statements it could
+        // parse are checked as well and one run reports all errors.
+        if (Tree)
+            Sema().semantic(Tree);
+        llvm::errs() << Buffer.getBufferIdentifier() << ": Syntax errors occurred\n";
+        return true;
     }
 
     // Perform semantic analysis on the AST.
     Sema Semantic;
-    if (Semantic.semantic(Tree))
+    bool SemaError;
     {
-        llvm::errs() << "Semantic errors occurred\n";
-        return 1;
+        PhaseReport::Region Time(Report.get(), "sema");
+        SemaError = Semantic.semantic(Tree);
+    }
+    if (SemaError)
+    {
+        llvm::errs() << Buffer.getBufferIdentifier() << ": Semantic errors occurred\n";
+        return true;
+    }
+
+    // Fold constant expressions so less code is generated, also without optimizations.
+    if (Fold)
+    {
+        Sema::FoldStats Stats;
+        {
+            PhaseReport::Region Time(Report.get(), "fold");
+            Semantic.fold(Tree, Stats);
+        }
+        if (Report)
+        {
+            Report->count("fold", "expr_nodes", Stats.Nodes);
+            Report->count("fold", "eliminated", Stats.Eliminated);
+            Report->count("fold", "propagated", Stats.Propagated);
+        }
+        if (FoldStats)
+            llvm::errs() << Buffer.getBufferIdentifier() << ": folding eliminated " << Stats.Eliminated
+                         << " of " << Stats.Nodes << " expression nodes, " << Stats.Propagated
+                         << " uses of variables replaced by their value\n";
     }
 
     // Generate code for the AST using a code generator.
-    CodeGen CodeGenerator;
-    CodeGenerator.compile(Tree);
+    bool Failed;
+    if (Execute)
+    {
+        // Execute the program and hand its exit code back to the caller.
+        Failed = CodeGenerator.run(Tree, Result);
+    }
+    else if (UseCache)
+    {
+        // Compile into a new cache entry and write the output from there.
+        llvm::SmallString<128> TempFile;
+        Failed = Cache->createTemporary(TempFile);
+        if (!Failed && CodeGenerator.compile(Tree, TempFile, CachedKind))
+        {
+            llvm::sys::fs::remove(TempFile);
+            Failed = true;
+        }
+        Failed = Failed || Cache->insert(Key, TempFile) ||
+                 writeCached(CodeGenerator, Cache->getPath(Key), Output, Kind);
+    }
+    else
+        Failed = CodeGenerator.compile(Tree, Output, Kind);
+
+    // The AST is no longer needed, release all of its nodes in one shot.
+    Context.reset();
+    return Failed;
+}
+
+// Loads an input file. Files are mmap-ed if possible and the lexer works on
+// the buffer directly, so it needs no null terminator.
+static std::unique_ptr<llvm::MemoryBuffer> readInput(llvm::StringRef File)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+        llvm::MemoryBuffer::getFileOrSTDIN(File, /*IsText=*/false,
+                                           /*RequiresNullTerminator=*/false);
+    if (std::error_code EC = FileOrErr.getError())
+    {
+        llvm::errs() << "Cannot read " << File << ": " << EC.message() << "\n";
+        return nullptr;
+    }
+    return std::move(*FileOrErr);
+}
+
+// Returns the name of the output file written next to Input, e.g. a.ll for
+// a.gsm, or a for an executable.
+static std::string outputFor(llvm::StringRef Input, CodeGen::EmitKind Kind)
+{
+    static const char *Extensions[] = {".ll", ".bc", ".s", ".o", ""};
+    llvm::SmallString<128> Output(Input);
+    llvm::sys::path::replace_extension(Output, Extensions[Kind]);
+    return std::string(Output.str());
+}
+
+// Compiles every input file into an output file next to it, on a pool of
+// Jobs threads. Each file is compiled independently, so an error in one file
+// does not stop the others.
+static int compileFiles()
+{
+    CodeGen::EmitKind Kind = Emit;
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Jobs));
+    std::atomic<unsigned> Failures(0);
+    for (const std::string &Input : InputFiles)
+    {
+        Pool.async([&Input, Kind, &Failures]()
+                   {
+                       std::unique_ptr<llvm::MemoryBuffer> Buffer = readInput(Input);
+                       int Result = 0;
+                       if (!Buffer || compileProgram(*Buffer, outputFor(Input, Kind), Kind,
+                                                     /*Execute=*/false, OptimizationLevel, Result))
+                           ++Failures;
+                   });
+    }
+    Pool.wait();
+    return Failures ? 1 : 0;
+}
+
+// Compiles a request of the compile server. The output goes to the standard
+// output, which the server captures.
+static bool compileRequest(const llvm::MemoryBuffer &Buffer, server::Action Act,
+                           unsigned OptLevel, int &Result)
+{
+    // the actions for output files are numbered like the EmitKinds
+    return compileProgram(Buffer, "-", static_cast<CodeGen::EmitKind>(Act),
+                          Act == server::ActionRun, OptLevel, Result);
+}
+
+// The main function of the Grammer.
+int main(int argc, const char **argv)
+{
+    // Initialize the LLVM framework.
+    llvm::InitLLVM X(argc, argv);
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // Parse command-line options.
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM - the expression compiler\n");
+
+    // Set up the compilation cache; the statistics are printed on exit.
+    if (!CacheDir.empty())
+        Cache = std::make_unique<CompileCache>(CacheDir, (uint64_t)CacheSize << 20);
+    struct StatsPrinter
+    {
+        ~StatsPrinter()
+        {
+            if (Cache && CacheStats)
+                Cache->printStats(llvm::errs());
+        }
+    } PrintStats;
+
+    // As a server, LLVM stays initialized for all requests.
+    if (Serve)
+        return server::serve(SocketPath, compileRequest) ? 1 : 0;
+
+    // Several input files are compiled in parallel, each into its own output.
+    if (InputFiles.size() > 1)
+    {
+        if (Program.getNumOccurrences() || Run || OutputFile.getNumOccurrences())
+        {
+            llvm::errs() << "-e, --run and -o take a single input file\n";
+            return 1;
+        }
+        return compileFiles();
+    }
+
+    // Load the input.
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (Program.getNumOccurrences())
+        Buffer = llvm::MemoryBuffer::getMemBuffer(Program, "<command line>");
+    else if (!(Buffer = readInput(InputFiles.empty() ? "-" : InputFiles.front())))
+        return 1;
+
+    // Without --emit, the extension of the output file selects the format.
+    CodeGen::EmitKind Kind = Emit.getNumOccurrences() ? Emit : emitKindFor(OutputFile);
+    std::string Output = OutputFile;
+    if (Kind == CodeGen::EmitExe && Output == "-")
+        Output = "a.out";
+
+    int Result = 0;
+    if (compileProgram(*Buffer, Output, Kind, Run, OptimizationLevel, Result))
+        return 1;
 
     // The Grammer executed successfully.
-    return 0;
+    return Result;
 }
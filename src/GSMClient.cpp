@@ -0,0 +1,121 @@
+// gsmc, the thin client of the compile server started with gsm --serve. It
+// only sends the program and prints the answer, so it links LLVMSupport
+// alone and starts much faster than gsm itself.
+#include "Server.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Define a command-line option for specifying the input file, '-' being the standard input.
+static llvm::cl::opt<std::string>
+    InputFile(llvm::cl::Positional,
+              llvm::cl::desc("<input file>"),
+              llvm::cl::init("-"));
+
+// Define a command-line option for passing the program text directly.
+static llvm::cl::opt<std::string>
+    Program("e",
+            llvm::cl::desc("Compile the given program text instead of a file"),
+            llvm::cl::value_desc("program"));
+
+// Define a command-line option for executing the program on the server.
+static llvm::cl::opt<bool>
+    Run("run",
+        llvm::cl::desc("Execute the program with the JIT of the server"),
+        llvm::cl::init(false));
+
+// Define a command-line option for the output file.
+static llvm::cl::opt<std::string>
+    OutputFile("o",
+               llvm::cl::desc("Output file, '-' for the standard output"),
+               llvm::cl::value_desc("filename"),
+               llvm::cl::init("-"));
+
+// Define a command-line option for the kind of output file.
+static llvm::cl::opt<server::Action>
+    Emit("emit",
+         llvm::cl::desc("Kind of output file:"),
+         llvm::cl::values(clEnumValN(server::ActionLL, "ll", "Textual LLVM IR (default)"),
+                          clEnumValN(server::ActionBC, "bc", "LLVM bitcode"),
+                          clEnumValN(server::ActionAsm, "asm", "Native assembly"),
+                          clEnumValN(server::ActionObj, "obj", "Native object file")),
+         llvm::cl::init(server::ActionLL));
+
+// Define a command-line option for the socket of the compile server.
+static llvm::cl::opt<std::string>
+    SocketPath("socket",
+               llvm::cl::desc("Socket of the compile server"),
+               llvm::cl::value_desc("path"),
+               llvm::cl::init(server::getDefaultSocketPath()));
+
+// Define the -O0 to -O3 options for the optimization pipeline of the server.
+enum OptLevel
+{
+    O0,
+    O1,
+    O2,
+    O3
+};
+static llvm::cl::opt<OptLevel>
+    OptimizationLevel(llvm::cl::desc("Optimization level:"),
+                      llvm::cl::values(clEnumVal(O0, "No optimizations (default)"),
+                                       clEnumVal(O1, "Enable basic optimizations"),
+                                       clEnumVal(O2, "Enable default optimizations and vectorization"),
+                                       clEnumVal(O3, "Enable aggressive optimizations")),
+                      llvm::cl::init(O0));
+
+// Guesses the kind of output file from the extension of the output file name.
+static server::Action actionFor(llvm::StringRef File)
+{
+    if (File.endswith(".bc"))
+        return server::ActionBC;
+    if (File.endswith(".s"))
+        return server::ActionAsm;
+    if (File.endswith(".o"))
+        return server::ActionObj;
+    return server::ActionLL;
+}
+
+int main(int argc, const char **argv)
+{
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "GSM - compile server client\n");
+
+    // Load the input.
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (Program.getNumOccurrences())
+        Buffer = llvm::MemoryBuffer::getMemBuffer(Program, "<command line>");
+    else
+    {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+            llvm::MemoryBuffer::getFileOrSTDIN(InputFile, /*IsText=*/false,
+                                               /*RequiresNullTerminator=*/false);
+        if (std::error_code EC = FileOrErr.getError())
+        {
+            llvm::errs() << "Cannot read " << InputFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*FileOrErr);
+    }
+
+    // The output of a program run on the server always goes to the standard output.
+    std::error_code EC;
+    llvm::raw_fd_ostream Out(Run ? std::string("-") : OutputFile, EC, llvm::sys::fs::OF_None);
+    if (EC)
+    {
+        llvm::errs() << "Cannot open " << OutputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+
+    // Without --emit, the extension of the output file selects the format.
+    server::Action Act = Run ? server::ActionRun
+                             : Emit.getNumOccurrences() ? Emit
+                                                        : actionFor(OutputFile);
+    int Result = 0;
+    if (server::request(SocketPath, Buffer->getBuffer(), Act, OptimizationLevel,
+                        Out, llvm::errs(), Result))
+        return 1;
+    return Result;
+}
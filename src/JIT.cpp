@@ -0,0 +1,77 @@
+#include "JIT.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// The runtime from rtGSM.c, linked into the gsm executable.
+extern "C" void gsm_write(int v);
+extern "C" void gsm_write_buffered(int v);
+extern "C" void gsm_flush(void);
+extern "C" int gsm_read(char *s);
+extern "C" void gsm_prof_dump(const unsigned long long *counts, int n, const char *file);
+
+namespace
+{
+  // Returns the wall-clock time elapsed since Start in milliseconds.
+  double elapsed(const TimeRecord &Start)
+  {
+    return (TimeRecord::getCurrentTime(false).getWallTime() - Start.getWallTime()) * 1000.0;
+  }
+}
+
+bool JIT::run(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx, int &Result)
+{
+  TimeRecord Start = TimeRecord::getCurrentTime(true);
+
+  auto JOrErr = orc::LLJITBuilder().create();
+  if (!JOrErr)
+  {
+    errs() << "Cannot create JIT: " << toString(JOrErr.takeError()) << "\n";
+    return true;
+  }
+  std::unique_ptr<orc::LLJIT> J = std::move(*JOrErr);
+
+  // Resolve the runtime functions to the implementations inside this process.
+  static const struct
+  {
+    const char *Name;
+    void *Address;
+  } RuntimeFunctions[] = {{"gsm_write", (void *)&gsm_write},
+                          {"gsm_write_buffered", (void *)&gsm_write_buffered},
+                          {"gsm_flush", (void *)&gsm_flush},
+                          {"gsm_read", (void *)&gsm_read},
+                          {"gsm_prof_dump", (void *)&gsm_prof_dump}};
+  orc::SymbolMap Runtime;
+  for (const auto &F : RuntimeFunctions)
+    Runtime[J->mangleAndIntern(F.Name)] =
+        JITEvaluatedSymbol(pointerToJITTargetAddress(F.Address), JITSymbolFlags::Exported);
+  if (auto Err = J->getMainJITDylib().define(orc::absoluteSymbols(std::move(Runtime))))
+  {
+    errs() << "Cannot define runtime symbols: " << toString(std::move(Err)) << "\n";
+    return true;
+  }
+
+  M->setDataLayout(J->getDataLayout());
+  if (auto Err = J->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+  {
+    errs() << "Cannot add module to JIT: " << toString(std::move(Err)) << "\n";
+    return true;
+  }
+
+  // Looking up main materializes the module, so this includes code generation.
+  auto MainSym = J->lookup("main");
+  if (!MainSym)
+  {
+    errs() << "Cannot find main: " << toString(MainSym.takeError()) << "\n";
+    return true;
+  }
+  auto *Main = jitTargetAddressToFunction<int (*)(int, char **)>(MainSym->getAddress());
+  CompileTime = elapsed(Start);
+
+  Start = TimeRecord::getCurrentTime(true);
+  Result = Main(0, nullptr);
+  ExecuteTime = elapsed(Start);
+  return false;
+}
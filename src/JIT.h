@@ -0,0 +1,27 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <memory>
+
+// Runs a module produced by CodeGen in-process with an ORC LLJIT. The calls
+// of the runtime functions are bound to the rtGSM.c runtime linked into gsm.
+class JIT
+{
+  double CompileTime; // milliseconds spent turning the module into native code
+  double ExecuteTime; // milliseconds spent inside main
+
+public:
+  JIT() : CompileTime(0), ExecuteTime(0) {}
+
+  // Compiles the module and calls its main function. Returns true if the
+  // module could not be compiled, otherwise stores the exit code in Result.
+  bool run(std::unique_ptr<llvm::Module> M,
+           std::unique_ptr<llvm::LLVMContext> Ctx, int &Result);
+
+  double getCompileTime() { return CompileTime; }
+  double getExecuteTime() { return ExecuteTime; }
+};
+
+#endif
@@ -1,90 +1,294 @@
 #include "Lexer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 
 // classifying characters
 namespace charinfo
 {
+    // character classes, one bit per class
+    enum : unsigned char
+    {
+        Whitespace = 1,
+        Digit = 2,
+        Letter = 4
+    };
+
+    struct CharTable
+    {
+        unsigned char Classes[256];
+    };
+
+    // computes the class of every byte value at compile time
+    constexpr CharTable buildTable()
+    {
+        CharTable T{};
+        for (int c = 0; c < 256; ++c)
+        {
+            if (c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r' || c == '\n')
+                T.Classes[c] = Whitespace;
+            else if (c >= '0' && c <= '9')
+                T.Classes[c] = Digit;
+            else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+                T.Classes[c] = Letter;
+        }
+        return T;
+    }
+
+    constexpr CharTable Table = buildTable();
+
     // ignore whitespaces
-    LLVM_READNONE inline bool isWhitespace(char c){
-        return (c == ' ' || c == '\t' || c == '\f' || c == '\v' ||
-               c == '\r' || c == '\n');
-    },
+    LLVM_READNONE inline bool isWhitespace(char c)
+    {
+        return Table.Classes[(unsigned char)c] & Whitespace;
+    }
 
     LLVM_READNONE inline bool isDigit(char c)
     {
-        return c >= '0' && c <= '9';
-    },
+        return Table.Classes[(unsigned char)c] & Digit;
+    }
 
     LLVM_READNONE inline bool isLetter(char c)
     {
-        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        return Table.Classes[(unsigned char)c] & Letter;
     }
 }
 
-void Lexer::next(Token &token)
+// scanning runs of characters of one class
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define GSM_LEXER_X86 1
+#include <immintrin.h>
+#endif
+
+// The scanning loops return the first position in [Ptr, End) that is not of
+// their class, or End.
+struct Lexer::Scanner
 {
-    while (*BufferPtr && charinfo::isWhitespace(*BufferPtr))
+    const char *(*skipWhitespace)(const char *Ptr, const char *End);
+    const char *(*skipLetters)(const char *Ptr, const char *End);
+    const char *(*skipDigits)(const char *Ptr, const char *End);
+};
+
+namespace
+{
+    template <unsigned char Class>
+    const char *scanScalar(const char *Ptr, const char *End)
     {
-        ++BufferPtr;
+        while (Ptr != End && (charinfo::Table.Classes[(unsigned char)*Ptr] & Class))
+            ++Ptr;
+        return Ptr;
     }
 
-    // make sure we didn't reach the end of input
-    if (!*BufferPtr)
+#ifdef GSM_LEXER_X86
+    // The classes are tested without a table: a byte is in the range [Lo, Lo + N]
+    // if the byte minus Lo is unchanged by an unsigned minimum with N.
+    inline __m128i inRange(__m128i V, char Lo, char N)
     {
-        token.Kind = Token::eoi;
-        return;
+        __m128i D = _mm_sub_epi8(V, _mm_set1_epi8(Lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(D, _mm_set1_epi8(N)), D);
     }
 
-    // collect characters and check for keywords or ident
-    if (charinfo::isLetter(*BufferPtr))
+    // ' ' and '\t' to '\r'
+    inline __m128i whitespaceMask(__m128i V)
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8(' ')), inRange(V, '\t', 4));
+    }
+
+    // setting bit 5 maps upper case letters to lower case ones
+    inline __m128i letterMask(__m128i V)
     {
-        const char *end = BufferPtr + 1;
-        while (charinfo::isLetter(*end))
-            ++end;
+        return inRange(_mm_or_si128(V, _mm_set1_epi8(0x20)), 'a', 25);
+    }
 
-        llvm::StringRef Name(BufferPtr, end - BufferPtr);
-        Token::TokenType kind;
-        switch (Name)
+    inline __m128i digitMask(__m128i V)
+    {
+        return inRange(V, '0', 9);
+    }
+
+    template <__m128i (*Mask)(__m128i), unsigned char Class>
+    const char *scanSSE2(const char *Ptr, const char *End)
+    {
+        // never load past the end, the buffer may be an mmap-ed file
+        while (End - Ptr >= 16)
         {
-        case "int":
-            kind = Token::KW_int;
-            break;
-        case "and":
-            kind = Token::KW_and;
-            break;
-        case "or":
-            kind = Token::KW_or;
-            break;
-        case Name == "if":
-            kind = Token::KW_if;
-            break;
-        case Name == "begin":
-            kind = Token::KW_begin;
-            break;
-        case Name == "end":
-            kind = Token::KW_end;
-            break;
-        case Name == "elif":
-            kind = Token::KW_elif;
-            break;
-        case Name == "else":
-            kind = Token::KW_else;
-            break;
-        case Name == "loop":
-            kind = Token::KW_loop;
-            break;
-        case Name == "loopc":
-            kind = Token::KW_loopc;
+            __m128i V = _mm_loadu_si128((const __m128i *)Ptr);
+            unsigned Outside = ~(unsigned)_mm_movemask_epi8(Mask(V)) & 0xFFFF;
+            if (Outside)
+                return Ptr + __builtin_ctz(Outside);
+            Ptr += 16;
+        }
+        return scanScalar<Class>(Ptr, End);
+    }
+
+    // the same for 32 characters, compiled for AVX2 only
+    __attribute__((target("avx2"))) inline __m256i inRange256(__m256i V, char Lo, char N)
+    {
+        __m256i D = _mm256_sub_epi8(V, _mm256_set1_epi8(Lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(D, _mm256_set1_epi8(N)), D);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i whitespaceMask256(__m256i V)
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8(' ')), inRange256(V, '\t', 4));
+    }
+
+    __attribute__((target("avx2"))) inline __m256i letterMask256(__m256i V)
+    {
+        return inRange256(_mm256_or_si256(V, _mm256_set1_epi8(0x20)), 'a', 25);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i digitMask256(__m256i V)
+    {
+        return inRange256(V, '0', 9);
+    }
+
+    template <__m256i (*Mask)(__m256i), __m128i (*Mask128)(__m128i), unsigned char Class>
+    __attribute__((target("avx2"))) const char *scanAVX2(const char *Ptr, const char *End)
+    {
+        while (End - Ptr >= 32)
+        {
+            __m256i V = _mm256_loadu_si256((const __m256i *)Ptr);
+            unsigned Outside = ~(unsigned)_mm256_movemask_epi8(Mask(V));
+            if (Outside)
+                return Ptr + __builtin_ctz(Outside);
+            Ptr += 32;
+        }
+        return scanSSE2<Mask128, Class>(Ptr, End);
+    }
+#endif
+
+}
+
+namespace
+{
+    // Most runs are only a few characters long, so the first characters are
+    // tested inline and only longer runs are handed to the scanning loop.
+    template <unsigned char Class>
+    inline const char *skip(const char *Ptr, const char *End,
+                            const char *(*Scan)(const char *, const char *))
+    {
+        for (unsigned I = 0; I < 8; ++I, ++Ptr)
+            if (Ptr == End || !(charinfo::Table.Classes[(unsigned char)*Ptr] & Class))
+                return Ptr;
+        return Scan(Ptr, End);
+    }
+}
+
+bool Lexer::isSupported(ScanKind Kind)
+{
+    switch (Kind)
+    {
+    case Scalar:
+        return true;
+#ifdef GSM_LEXER_X86
+    case SSE2:
+        return true;
+    case AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+Lexer::ScanKind Lexer::getBestScanKind()
+{
+    static const ScanKind Best = isSupported(AVX2) ? AVX2 : isSupported(SSE2) ? SSE2
+                                                                               : Scalar;
+    return Best;
+}
+
+const Lexer::Scanner *Lexer::getScanner(ScanKind Kind)
+{
+    static const Scanner ScalarScanner = {
+        scanScalar<charinfo::Whitespace>,
+        scanScalar<charinfo::Letter>,
+        scanScalar<charinfo::Digit>};
+#ifdef GSM_LEXER_X86
+    static const Scanner SSE2Scanner = {
+        scanSSE2<whitespaceMask, charinfo::Whitespace>,
+        scanSSE2<letterMask, charinfo::Letter>,
+        scanSSE2<digitMask, charinfo::Digit>};
+    static const Scanner AVX2Scanner = {
+        scanAVX2<whitespaceMask256, whitespaceMask, charinfo::Whitespace>,
+        scanAVX2<letterMask256, letterMask, charinfo::Letter>,
+        scanAVX2<digitMask256, digitMask, charinfo::Digit>};
+
+    if (Kind == AVX2 && isSupported(AVX2))
+        return &AVX2Scanner;
+    if (Kind == SSE2)
+        return &SSE2Scanner;
+#endif
+    return &ScalarScanner;
+}
+
+// recognizing keywords
+namespace
+{
+    // returns Kind if the identifier is the keyword, ident otherwise
+    inline Token::TokenType match(const char *Start, size_t Len, const char *Keyword, Token::TokenType Kind)
+    {
+        return memcmp(Start, Keyword, Len) == 0 ? Kind : Token::ident;
+    }
+
+    // Selects the only keyword an identifier can be by its length and first
+    // character, so each identifier is compared with at most one keyword.
+    Token::TokenType keywordKind(const char *Start, size_t Len)
+    {
+        switch (Len)
+        {
+        case 2:
+            if (Start[0] == 'i')
+                return match(Start, Len, "if", Token::KW_if);
+            if (Start[0] == 'o')
+                return match(Start, Len, "or", Token::KW_or);
             break;
-        case Name == "True":
-            kind = Token::KW_true;
+        case 3:
+            if (Start[0] == 'i')
+                return match(Start, Len, "int", Token::KW_int);
+            if (Start[0] == 'a')
+                return match(Start, Len, "and", Token::KW_and);
+            if (Start[0] == 'e')
+                return match(Start, Len, "end", Token::KW_end);
             break;
-        case Name == "False":
-            kind = Token::KW_false;
+        case 4:
+            // elif and else differ in the third character
+            if (Start[0] == 'e')
+                return Start[2] == 'i' ? match(Start, Len, "elif", Token::KW_elif)
+                                       : match(Start, Len, "else", Token::KW_else);
+            if (Start[0] == 'T')
+                return match(Start, Len, "True", Token::KW_true);
             break;
-        default:
-            kind = Token::ident;
+        case 5:
+            if (Start[0] == 'b')
+                return match(Start, Len, "begin", Token::KW_begin);
+            if (Start[0] == 'l')
+                return match(Start, Len, "loopc", Token::KW_loopc);
+            if (Start[0] == 'F')
+                return match(Start, Len, "False", Token::KW_false);
             break;
         }
+        return Token::ident;
+    }
+}
+
+void Lexer::lex(Token &token)
+{
+    BufferPtr = skip<charinfo::Whitespace>(BufferPtr, BufferEnd, Scan->skipWhitespace);
+
+    // make sure we didn't reach the end of input
+    if (BufferPtr == BufferEnd)
+    {
+        formToken(token, BufferPtr, Token::eoi);
+        return;
+    }
+
+    // collect characters and check for keywords or ident
+    if (charinfo::isLetter(*BufferPtr))
+    {
+        const char *end = skip<charinfo::Letter>(BufferPtr + 1, BufferEnd, Scan->skipLetters);
+
+        Token::TokenType kind = keywordKind(BufferPtr, end - BufferPtr);
 
         // generate the token
         formToken(token, end, kind);
@@ -94,44 +298,44 @@ void Lexer::next(Token &token)
     // check for numbers
     else if (charinfo::isDigit(*BufferPtr))
     {
-        const char *end = BufferPtr + 1;
-        while (charinfo::isDigit(*end))
-            ++end;
+        const char *end = skip<charinfo::Digit>(BufferPtr + 1, BufferEnd, Scan->skipDigits);
         formToken(token, end, Token::number);
         return;
     }
 
     else
     {
+        // operators followed by '=' form a single token (maximal munch)
+        bool EqualFollows = BufferPtr + 1 != BufferEnd && BufferPtr[1] == '=';
         switch (*BufferPtr)
         {
 #define CASE(ch, tok)                         \
     case ch:                                  \
         formToken(token, BufferPtr + 1, tok); \
         break
-            CASE(',', Token::Token::comma);
+#define CASE_EQ(ch, tok, tok_eq)                           \
+    case ch:                                               \
+        if (EqualFollows)                                  \
+            formToken(token, BufferPtr + 2, tok_eq);       \
+        else                                               \
+            formToken(token, BufferPtr + 1, tok);          \
+        break
+            CASE(',', Token::comma);
             CASE(';', Token::semicolon);
             CASE('(', Token::l_paren);
             CASE(')', Token::r_paren);
-            CASE('^', Token::ci);
-            CASE('*', Token::star);
-            CASE('/', Token::slash);
-            CASE('%', Token::percent);
-            CASE('+', Token::plus);
-            CASE('-', Token::minus);
-            CASE('>', Token::g_than);
-            CASE('<', Token::l_than);
-            CASE('>=', Token::g_than_eq);
-            CASE('<=', Token::l_than_eq);
-            CASE('==', Token::equality);
-            CASE('!=', Token::not_equal);
-            CASE('=', Token::equal);
-            CASE('+=', Token::add);
-            CASE('*=', Token::multi);
-            CASE('/=', Token::div);
-            CASE('-=', Token::sub);
-            CASE('%=', Token::left_over);
+            CASE('^', Token::power);
             CASE(':', Token::colon);
+            CASE_EQ('*', Token::star, Token::multi);
+            CASE_EQ('/', Token::slash, Token::div);
+            CASE_EQ('%', Token::percent, Token::left_over);
+            CASE_EQ('+', Token::plus, Token::add);
+            CASE_EQ('-', Token::minus, Token::sub);
+            CASE_EQ('>', Token::g_than, Token::g_than_eq);
+            CASE_EQ('<', Token::l_than, Token::l_than_eq);
+            CASE_EQ('=', Token::equal, Token::equality);
+            CASE_EQ('!', Token::unknown, Token::not_equal);
+#undef CASE_EQ
 #undef CASE
         default:
             formToken(token, BufferPtr + 1, Token::unknown);
@@ -146,4 +350,58 @@ void Lexer::formToken(Token &Tok, const char *TokEnd,
     Tok.Kind = Kind;
     Tok.Text = llvm::StringRef(BufferPtr, TokEnd - BufferPtr);
     BufferPtr = TokEnd;
+    ++NumTokens;
+}
+
+const Token &Lexer::peek(unsigned N)
+{
+    assert(N < LookaheadSize && "lookahead too far");
+    while (Count <= N)
+    {
+        lex(Ring[(Head + Count) & (LookaheadSize - 1)]);
+        ++Count;
+    }
+    return Ring[(Head + N) & (LookaheadSize - 1)];
+}
+
+bool Lexer::tokenizeAll(TokenBuffer &Tokens)
+{
+    if (BufferEnd - BufferStart > UINT32_MAX)
+        return true;
+
+    Tokens.Source = llvm::StringRef(BufferStart, BufferEnd - BufferStart);
+
+    // The arrays are sized for about four bytes per token and written through
+    // raw pointers. They only grow, so a reused buffer is not cleared again.
+    size_t Size = 0;
+    Token Tok;
+    do
+    {
+        size_t Capacity = std::max<size_t>((BufferEnd - BufferPtr) / 4 + Count + 16, 2 * Size);
+        if (Tokens.Kinds.size() < Capacity)
+        {
+            Tokens.Kinds.resize(Capacity);
+            Tokens.Offsets.resize(Capacity);
+            Tokens.Lengths.resize(Capacity);
+        }
+        Capacity = Tokens.Kinds.size();
+        unsigned short *Kinds = Tokens.Kinds.data();
+        uint32_t *Offsets = Tokens.Offsets.data();
+        uint32_t *Lengths = Tokens.Lengths.data();
+        do
+        {
+            // the tokens already peeked come first
+            if (Count)
+                next(Tok);
+            else
+                lex(Tok);
+            Kinds[Size] = Tok.Kind;
+            Offsets[Size] = Tok.Text.data() - BufferStart;
+            Lengths[Size] = Tok.Text.size();
+            ++Size;
+        } while (Tok.Kind != Token::eoi && Size != Capacity);
+    } while (Tok.Kind != Token::eoi);
+
+    Tokens.NumTokens = Size;
+    return false;
 }
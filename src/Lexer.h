@@ -3,12 +3,16 @@
 
 #include "llvm/ADT/StringRef.h"        // encapsulates a pointer to a C string and its length
 #include "llvm/Support/MemoryBuffer.h" // read-only access to a block of memory, filled with the content of a file
+#include <cstdint>
+#include <vector>
 
 class Lexer;
+class TokenBuffer;
 
 class Token
 {
-    friend class Lexer; // Lexer can access private and protected members of Token
+    friend class Lexer;       // Lexer can access private and protected members of Token
+    friend class TokenBuffer; // TokenBuffer rebuilds tokens from its arrays
 
 public:
     enum TokenType : unsigned short
@@ -31,7 +35,7 @@ public:
         KW_and,     // and
         KW_or,      // or
         KW_true,    // True
-        KW_false    // False
+        KW_false,   // False
 
         not_equal,  // !=
         ident,      // a
@@ -79,21 +83,118 @@ public:
         const { return is(K1) || isOneOf(K2, Ks...); }
 };
 
+// All tokens of an input, lexed up front by Lexer::tokenizeAll. The tokens
+// are stored as a struct of arrays, so the parser walks three dense arrays
+// instead of calling into the lexer for every token. The texts are kept as
+// 32-bit offsets into the input, which limits an input to 4 GiB. The last
+// token is always eoi.
+class TokenBuffer
+{
+    friend class Lexer;
+
+    llvm::StringRef Source;           // the input the tokens point into
+    std::vector<unsigned short> Kinds; // Token::TokenType of each token
+    std::vector<uint32_t> Offsets;     // start of each token in Source
+    std::vector<uint32_t> Lengths;     // length of each token
+    size_t NumTokens = 0;              // the arrays may be larger than this
+
+public:
+    size_t size() const { return NumTokens; }
+
+    Token::TokenType getKind(size_t I) const { return (Token::TokenType)Kinds[I]; }
+
+    llvm::StringRef getText(size_t I) const
+    {
+        return llvm::StringRef(Source.data() + Offsets[I], Lengths[I]);
+    }
+
+    Token get(size_t I) const
+    {
+        Token Tok;
+        Tok.Kind = getKind(I);
+        Tok.Text = getText(I);
+        return Tok;
+    }
+};
+
 class Lexer
 {
+public:
+    // The implementations of the loops skipping runs of whitespace, letters
+    // and digits. They all produce the same tokens; by default the fastest
+    // one supported by the CPU is selected at runtime.
+    enum ScanKind
+    {
+        Scalar, // one character at a time
+        SSE2,   // 16 characters at a time
+        AVX2    // 32 characters at a time
+    };
+
+private:
+    struct Scanner;
+
     const char *BufferStart; // pointer to the beginning of the input
     const char *BufferPtr;   // pointer to the next unprocessed character
+    const char *BufferEnd;   // pointer past the last character of the input
+    const Scanner *Scan;     // the selected scanning loops
+
+    // Tokens lexed ahead by peek() and not yet returned by next(), in a ring
+    // buffer starting at Head.
+    static constexpr unsigned LookaheadSize = 8;
+    Token Ring[LookaheadSize];
+    unsigned Head = 0;
+    unsigned Count = 0;
+
+    size_t NumTokens = 0; // tokens lexed so far, including the ones ahead
+
+    static const Scanner *getScanner(ScanKind Kind);
 
 public:
-    Lexer(const llvm::StringRef &Buffer)
+    // The lexer does not copy the input, the tokens point into Buffer. The
+    // buffer needs no null terminator, so mmap-ed files can be used directly.
+    Lexer(const llvm::StringRef &Buffer, ScanKind Kind = getBestScanKind())
     {
         BufferStart = Buffer.begin();
         BufferPtr = BufferStart;
+        BufferEnd = Buffer.end();
+        Scan = getScanner(Kind);
     }
 
-    void next(Token &token); // return the next token
+    Lexer(const llvm::MemoryBuffer &Buffer, ScanKind Kind = getBestScanKind())
+        : Lexer(Buffer.getBuffer(), Kind) {}
+
+    // tests if the scanning loops can run on this CPU
+    static bool isSupported(ScanKind Kind);
+
+    // returns the fastest scanning loops supported by this CPU
+    static ScanKind getBestScanKind();
+
+    // return the next token
+    void next(Token &token)
+    {
+        if (Count == 0)
+        {
+            lex(token);
+            return;
+        }
+        token = Ring[Head];
+        Head = (Head + 1) & (LookaheadSize - 1);
+        --Count;
+    }
+
+    // Returns the token N positions after the one the next call to next()
+    // returns, without consuming anything. N must be below LookaheadSize.
+    const Token &peek(unsigned N = 0);
+
+    // returns the number of tokens lexed so far
+    size_t getNumTokens() const { return NumTokens; }
+
+    // Lexes all remaining tokens into Tokens in one pass, ending with eoi.
+    // Returns true if the input is too large for 32-bit offsets.
+    bool tokenizeAll(TokenBuffer &Tokens);
 
 private:
+    void lex(Token &token);
     void formToken(Token &Result, const char *TokEnd, Token::TokenType Kind);
 };
 #endif
\ No newline at end of file
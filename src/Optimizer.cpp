@@ -0,0 +1,35 @@
+#include "Optimizer.h"
+#include "llvm/Passes/PassBuilder.h"
+
+using namespace llvm;
+
+void Optimizer::optimize(Module &M)
+{
+  OptimizationLevel OL = Level == 0   ? OptimizationLevel::O0
+                         : Level == 1 ? OptimizationLevel::O1
+                         : Level == 2 ? OptimizationLevel::O2
+                                      : OptimizationLevel::O3;
+
+  // Enable the vectorizers the same way clang does for -O2 and above.
+  PipelineTuningOptions PTO;
+  PTO.LoopVectorization = Level >= 2;
+  PTO.SLPVectorization = Level >= 2;
+  PTO.LoopUnrolling = Level >= 1;
+
+  PassBuilder PB(TM, PTO);
+
+  // Create the analysis managers and register them with each other.
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM = Level == 0 ? PB.buildO0DefaultPipeline(OL)
+                                     : PB.buildPerModuleDefaultPipeline(OL);
+  MPM.run(M, MAM);
+}
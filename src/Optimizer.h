@@ -0,0 +1,20 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+// Runs the default new pass manager pipeline for an optimization level over
+// the module generated by CodeGen.
+class Optimizer
+{
+  llvm::TargetMachine *TM; // target used for cost models, may be null
+  unsigned Level;          // 0 to 3, like -O0 to -O3
+
+public:
+  Optimizer(llvm::TargetMachine *TM, unsigned Level) : TM(TM), Level(Level) {}
+
+  void optimize(llvm::Module &M);
+};
+
+#endif
@@ -5,9 +5,9 @@
 
 // main point is that the whole input has been consumed
 
-ASTNode *Parser::parse()
+AST *Parser::parse()
 {
-    ASTNode *Res = parseATA();
+    AST *Res = parseATA();
     return Res;
 }
 
@@ -17,90 +17,122 @@ AST *Parser::parseATA()
 
     while (!Tok.is(Token::TokenType::eoi))
     {
-        switch (Tok.getKind())
+        // statements with errors are kept if they could be recovered, so
+        // Sema can still check them
+        if (Grammer *g = parseRecovering())
+            Grammers.push_back(g);
+    }
+    return Ctx.create<GrammerNode>(Ctx, Ctx.copy(llvm::makeArrayRef(Grammers)));
+}
+
+Grammer *Parser::parseStatement()
+{
+    unsigned Errors = NumErrors;
+    Grammer *g = parseRecovering();
+    return NumErrors == Errors ? g : nullptr;
+}
+
+// Parses a statement. After a syntax error the parser is synchronized to
+// the next statement and what could be recovered of the statement is
+// returned: a declaration of the names read so far, a statement with an
+// erroneous expression or assignment left out, or null.
+Grammer *Parser::parseRecovering()
+{
+    unsigned Errors = NumErrors;
+    Grammer *Res = nullptr;
+    switch (Tok.getKind())
+    {
+    case Token::TokenType::KW_int:
+        Res = parseVar();
+        break;
+
+    case Token::TokenType::ident:
+        // an identifier can only start an assignment, so the operator
+        // after it is checked before anything is parsed
+        if (!isAssignOp(peek()))
         {
-        case Token::TokenType::KW_int:
-            Grammer *d;
-            d = parseVar();
-            if (!Tok.is(Token::TokenType::semicolon))
-            {
-                error();
-                goto _error2;
-            }
-            if (d)
-                Grammers.push_back(d);
-            else
-                goto _error2;
+            go_ahead();
+            error();
             break;
+        }
+        Res = parseAssign();
+        break;
 
-        case Token::TokenType::ident:
-            Grammer *a;
-            a = parseAssign();
+    case Token::TokenType::KW_if:
+        Res = parseCondition(); // the final end is already consumed
+        break;
 
-            if (!Tok.is(Token::TokenType::semicolon))
-            {
-                error();
-                goto _error2;
-            }
-            if (a)
-                Grammers.push_back(a);
-            else
-                goto _error2;
-            break;
+    case Token::TokenType::KW_loopc:
+        Res = parseLoop(); // the final end is already consumed
+        break;
 
-        case Token::TokenType::KW_if:
-            Grammer *i;
-            i = parseCondition();
+    default:
+        error();
+        break;
+    }
+    if (NumErrors != Errors)
+        synchronize();
+    return Res;
+}
 
-            if (!Tok.is(Token::TokenType::KW_end))
-            {
-                error();
-                goto _error2;
-            }
-            if (i)
-                Grammers.push_back(i);
-            else
-                goto _error2;
-            break;
+// Panic mode: skips tokens after a syntax error until a statement can
+// start, behind the next ";" or "end" or in front of "int", "if", "loopc" or
+// an assignment. A block is skipped from its begin to its end, together
+// with the elif and else parts following it.
+void Parser::synchronize()
+{
+    bool InBlock = false;
+    for (;;)
+    {
+        switch (Tok.getKind())
+        {
+        case Token::TokenType::eoi:
+        case Token::TokenType::KW_int:
+        case Token::TokenType::KW_if:
         case Token::TokenType::KW_loopc:
-            Grammer *l;
-            l = parseLoop();
-
-            if (!Tok.is(Token::TokenType::KW_end))
+            return;
+        case Token::TokenType::semicolon:
+            if (!InBlock)
             {
-                error();
-                goto _error2;
+                go_ahead();
+                return;
             }
-            if (l)
-                Grammers.push_back(l);
-            else
-                goto _error2;
             break;
-
+        case Token::TokenType::KW_begin:
+            InBlock = true;
+            break;
+        case Token::TokenType::KW_end:
+            go_ahead();
+            if (!Tok.isOneOf(Token::TokenType::KW_elif, Token::TokenType::KW_else))
+                return;
+            InBlock = false;
+            continue;
+        case Token::TokenType::ident:
+            if (!InBlock && isAssignOp(peek()))
+                return;
+            break;
         default:
-            goto _error2;
             break;
         }
-        go_ahead(); // TODO: watch this Part
-    }
-    return new AST(Grammers);
-_error2:
-    while (Tok.getKind() != Token::TokenType::eoi)
         go_ahead();
-    return nullptr;
+    }
 }
 
-Grammer *Parser::parseVar()
+DecNode *Parser::parseVar()
 {
-    llvm::SmallVector<ComparisonNode *, 8> values;
+    llvm::SmallVector<ExprId, 8> values;
     llvm::SmallVector<llvm::StringRef, 8> vars;
-    ComparisonNode *initializer = (ComparisonNode *)new Factor(Factor::ValueKind::Number, llvm::StringRef myStringRef("0");) if (expect(Token::TokenType::KW_int)) goto _error;
+    llvm::SmallVector<SymbolId, 8> symbols;
+    int count = 1;
+
+    if (expect(Token::TokenType::KW_int))
+        goto _error;
     go_ahead();
     if (expect(Token::TokenType::ident))
         goto _error;
-    vars.push_back(Tok.getText());
+    symbols.push_back(Exprs.intern(Tok.getText()));
+    vars.push_back(Exprs.getSymbolName(symbols.back()));
     go_ahead();
-    int count = 1;
 
     while (Tok.is(Token::TokenType::comma))
     {
@@ -108,204 +140,312 @@ Grammer *Parser::parseVar()
         go_ahead();
         if (expect(Token::TokenType::ident))
             goto _error;
-        vars.push_back(Tok.getText());
+        symbols.push_back(Exprs.intern(Tok.getText()));
+        vars.push_back(Exprs.getSymbolName(symbols.back()));
         go_ahead();
     }
 
     if (Tok.is(Token::TokenType::equal))
     {
         go_ahead();
-        ComparisonNode *C = (ComparisonNode *)parseComp();
-        values.push_back(C);
+        values.push_back(parseComp());
         count--;
         while (Tok.is(Token::TokenType::comma))
         {
             if (count <= 0)
             {
+                // more values than variables
+                error();
                 goto _error;
             }
             go_ahead();
-            C = (ComparisonNode *)parseComp();
-            values.push_back(C);
+            values.push_back(parseComp());
             count--;
         }
     }
 
-    while (count > 0)
+    // variables without a value are initialized with 0
+    if (count > 0)
     {
-        values.push_back(initializer);
-        count--;
+        ExprId initializer = Exprs.number(0);
+        while (count > 0)
+        {
+            values.push_back(initializer);
+            count--;
+        }
     }
 
-    if (expect(Token::TokenType::semicolon))
+    if (consume(Token::TokenType::semicolon))
         goto _error;
 
-    return new DecNode(vars, values);
- _error: // TODO: Check this later in case of error :)
-    while (Tok.getKind() != Token::TokenType::eoi)
-        go_ahead();
-    return nullptr;
+    return Ctx.create<DecNode>(Ctx.copy(llvm::makeArrayRef(vars)), Ctx.copy(llvm::makeArrayRef(symbols)),
+                               Ctx.copy(llvm::makeArrayRef(values)));
+ _error:
+    // keep the variables read so far, so their uses are not reported as
+    // undeclared as well; the missing values are 0
+    if (vars.empty())
+        return nullptr;
+    values.resize(vars.size(), Exprs.number(0));
+    return Ctx.create<DecNode>(Ctx.copy(llvm::makeArrayRef(vars)), Ctx.copy(llvm::makeArrayRef(symbols)),
+                               Ctx.copy(llvm::makeArrayRef(values)));
 }
 
-Grammer *Parser::parseAssign()
+AssignNode *Parser::parseAssign()
 {
-}
+    SymbolId var;
+    AssignNode::Token op;
+    ExprId value;
 
-Grammer *Parser::parseComp()
-{
-    Grammer *Left = parsLogic();
-    if (Tok.isOneOf(Token::TokenType::KW_and, Token::TokenType::KW_or))
+    if (expect(Token::TokenType::ident))
+        goto _error;
+    var = Exprs.intern(Tok.getText());
+    go_ahead();
+
+    // "=" | "+=" | "-=" | "*=" | "/=" | "%=", each a single token
+    switch (Tok.getKind())
     {
-        ComparisonNode::BoolOp Op =
-            Tok.is(Token::TokenType::KW_and) ? ComparisonNode::BoolOp::AND : ComparisonNode::BoolOp::OR;
-        go_ahead();
-        Grammer *Right = parseComp();
-        Left = (Grammer *)new ComparisonNode((LogicNode *)Left, Op, (ComparisonNode *)Right);
+    case Token::TokenType::equal:
+        op = AssignNode::Token::EQUAL;
+        break;
+    case Token::TokenType::add:
+        op = AssignNode::Token::PLUS_EQUAL;
+        break;
+    case Token::TokenType::sub:
+        op = AssignNode::Token::MINUS_EQUAL;
+        break;
+    case Token::TokenType::multi:
+        op = AssignNode::Token::MULT_EQUAL;
+        break;
+    case Token::TokenType::div:
+        op = AssignNode::Token::DIVIDE_EQUAL;
+        break;
+    case Token::TokenType::left_over:
+        op = AssignNode::Token::MOD_EQUAL;
+        break;
+    default:
+        error();
+        goto _error;
     }
-    return Left;
+    go_ahead();
+    value = parseComp();
+
+    if (consume(Token::TokenType::semicolon))
+        goto _error;
+
+    return Ctx.create<AssignNode>(Exprs.getSymbolName(var), var, op, value);
+_error:
+    return nullptr;
 }
 
-Grammer *Parser::parsLogic()
+namespace
 {
-    Grammer *Left = parseExpr();
-    // "<" | ">" | "<=" | ">=" | "==" | "!="
-    if (Tok.isOneOf(Token::TokenType::l_than, Token::TokenType::g_than, Token::TokenType::g_than_eq, Token::TokenType::l_than_eq, Token::TokenType::equal, Token::TokenType::not_equal))
+    // A binary operator of grammer.txt. Operators of a higher precedence bind
+    // tighter; the precedence is 0 for tokens that are no binary operator.
+    struct BinaryOperator
     {
-        LogicNode::ComparisonOp op;
-        if (Tok.isOneOf(Token::TokenType::l_than))
-            op = LogicNode::ComparisonOp::LESS_THAN;
-        else if (Tok.isOneOf(Token::TokenType::g_than))
-            op = LogicNode::ComparisonOp::GREATER_THAN;
-        else if (Tok.isOneOf(Token::TokenType::g_than_eq))
-            op = LogicNode::ComparisonOp::GREATER_THAN_EQUAL;
-        else if (Tok.isOneOf(Token::TokenType::l_than_eq))
-            op = LogicNode::ComparisonOp::LESS_THAN_EQUAL;
-        else if (Tok.isOneOf(Token::TokenType::equal))
-            op = LogicNode::ComparisonOp::EQUAL;
-        else
-            op = LogicNode::ComparisonOp::NOT_EQUAL;
-        go_ahead();
-        Grammer *Right = parsLogic();
-        Left = new LogicNode((ExprNode *)Left, op, (LogicNode *)Right);
+        Expr::ExprKind Kind;
+        unsigned char Precedence;
+        bool RightAssoc;
+    };
+
+    // Expr -> Expr or Term, Term -> Term < TermPrime, TermPrime -> TermPrime + Op,
+    // Op -> Op * OpPrime and OpPrime -> Factor ^ OpPrime of grammer.txt, one
+    // line per operator. All operators are left associative except ^.
+    BinaryOperator getBinaryOperator(Token::TokenType Kind)
+    {
+        switch (Kind)
+        {
+        case Token::TokenType::KW_or:
+            return {Expr::Or, 1, false};
+        case Token::TokenType::KW_and:
+            return {Expr::And, 1, false};
+        case Token::TokenType::l_than:
+            return {Expr::LessThan, 2, false};
+        case Token::TokenType::g_than:
+            return {Expr::GreaterThan, 2, false};
+        case Token::TokenType::l_than_eq:
+            return {Expr::LessThanEqual, 2, false};
+        case Token::TokenType::g_than_eq:
+            return {Expr::GreaterThanEqual, 2, false};
+        case Token::TokenType::equality:
+            return {Expr::Equal, 2, false};
+        case Token::TokenType::not_equal:
+            return {Expr::NotEqual, 2, false};
+        case Token::TokenType::plus:
+            return {Expr::Plus, 3, false};
+        case Token::TokenType::minus:
+            return {Expr::Minus, 3, false};
+        case Token::TokenType::star:
+            return {Expr::Mul, 4, false};
+        case Token::TokenType::slash:
+            return {Expr::Div, 4, false};
+        case Token::TokenType::percent:
+            return {Expr::Mod, 4, false};
+        case Token::TokenType::power:
+            return {Expr::Power, 5, true};
+        default:
+            return {Expr::Number, 0, false};
+        }
     }
-    return Left;
 }
 
-Grammer *Parser::parseTerm()
+// Pops the pending operators of at least the given precedence and creates
+// their nodes. An open parenthesis has precedence 0 and stops it.
+void Parser::reduce(unsigned MinPrecedence)
 {
-    Grammer *Left = parsePower();
-    while (Tok.isOneOf(Token::TokenType::star, Token::TokenType::slash, Token::TokenType::percent))
+    while (!Operators.empty())
     {
-        TermNode::TermOp Op =
-            Tok.is(Token::TokenType::star) ? TermNode::TermOp::star : Tok.is(Token::TokenType::slash) ? TermNode::TermOp::devide
-                                                                                                      : TermNode::TermOp::precent;
-        go_ahead();
-        Grammer *Right = parseTerm();
-        Left = new TermNode((PowerNode *)Left, Op, (TermNode *)Right);
+        BinaryOperator Op = getBinaryOperator(Operators.back());
+        if (Op.Precedence < MinPrecedence || Op.Precedence == 0)
+            return;
+        Operators.pop_back();
+        ExprId Right = Operands.pop_back_val();
+        Operands.back() = Exprs.binary(Op.Kind, Operands.back(), Right);
     }
-    return Left;
 }
 
-Grammer *parseExpr()
+// Parses an expression by precedence climbing without recursion. The
+// operands and the operators waiting for their right operand are kept on
+// explicit stacks, so long operator chains and deep parentheses only grow
+// the stacks. The nodes are created in post-order, as the ExprPool expects.
+ExprId Parser::parseComp()
 {
-    Grammer *Left = (Grammer *)parseTerm();
-    if (Tok.isOneOf(Token::TokenType::plus, Token::TokenType::minus))
+    Operands.clear();
+    Operators.clear();
+    unsigned Open = 0; // parentheses not closed yet
+    unsigned Errors = NumErrors;
+    for (;;)
     {
-        ExprNode::ExprOp op;
-        if (Tok.isOneOf(Token::TokenType::plus))
+        // Factor -> (Expr), the parenthesis waits on the operator stack
+        while (Tok.is(Token::TokenType::l_paren))
         {
-            op = ExprNode::ExprOp::plus;
+            Operators.push_back(Token::TokenType::l_paren);
+            ++Open;
+            go_ahead();
         }
-        else
+        Operands.push_back(parseFactor());
+
+        while (Open && Tok.is(Token::TokenType::r_paren))
         {
-            op = ExprNode::ExprOp::minus;
+            reduce(1);
+            Operators.pop_back();
+            --Open;
+            go_ahead();
         }
+
+        BinaryOperator Op = getBinaryOperator(Tok.getKind());
+        if (Op.Precedence == 0)
+            break;
+        // A left associative operator first completes the operators of the
+        // same precedence in front of it, a right associative one waits.
+        reduce(Op.Precedence + Op.RightAssoc);
+        Operators.push_back(Tok.getKind());
         go_ahead();
-        Grammer *Right = parseExpr();
-        Left = new ExprNode((TermNode *)Left, op, (ExprNode *)Right);
     }
-    return Left;
-}
 
-Grammer *Parser::parsePower()
-{
-    Grammer *Left = parseFactor();
-    while (Tok.isOneOf(Token::TokenType::ci))
+    // Handle error: missing closing parenthesis, unless the error was
+    // reported already, e.g. for a missing operand
+    if (Open && NumErrors == Errors)
+        error();
+    reduce(1);
+    while (!Operators.empty())
     {
-        go_ahead();
-        Grammer *Right = parsePower();
-        Left = (Grammer *)new PowerNode((FactorNode *)Left, (PowerNode *)Right);
+        Operators.pop_back(); // an unclosed parenthesis
+        reduce(1);
     }
-    return Left;
+    return Operands.back();
 }
 
-Grammer *Parser::parseFactor()
+// Factor -> id | Num, parentheses are handled by parseComp()
+ExprId Parser::parseFactor()
 {
-    Grammer *Res = nullptr;
+    ExprId Res;
     switch (Tok.getKind())
     {
     case Token::TokenType::number:
-        Res = new Factor(Factor::Number, Tok.getText());
+        int32_t Value;
+        if (Tok.getText().getAsInteger(10, Value))
+        {
+            // the literal does not fit into 32 bits
+            error();
+            Value = 0;
+        }
+        Res = Exprs.number(Value);
         go_ahead();
         break;
     case Token::TokenType::ident:
-        Res = new Factor(Factor::Ident, Tok.getText());
+        Res = Exprs.ident(Exprs.intern(Tok.getText()));
         go_ahead();
         break;
-    case Token::TokenType::l_paren:
-        go_ahead();
-        Res = parseComp();
-        if (!consume(Token::TokenType::r_paren))
-        {
-            // Handle error: missing closing parenthesis
-            error();
-            return nullptr; // Return nullptr to indicate parsing failure
-        }
-        break; // Don't forget to break after successfully parsing the expression inside parentheses
     default:
-        // error handling
+        // Nothing is skipped, the caller synchronizes at the end of the
+        // statement. The placeholder keeps the tree well-formed for Sema,
+        // it is 1 so that it does not add a division by zero.
         error();
-        while (!Tok.isOneOf(Token::TokenType::r_paren, Token::TokenType::star, Token::TokenType::plus, Token::TokenType::minus, Token::TokenType::slash, Token::TokenType::eoi))
-            go_ahead();
+        Res = Exprs.number(1);
         break;
     }
     return Res;
 }
 
-Grammer *Parser::parseifPart()
+// parses ": begin Assignment... end" and consumes the final end
+bool Parser::parseBody(llvm::SmallVectorImpl<AssignNode *> &Assigns)
 {
-    Grammer *Res = nullptr;
-    IfPartNode *theIfStateMent;
-
-    if (!Tok.is(Token::TokenType::KW_if))
+    if (consume(Token::TokenType::colon))
+        return true;
+    if (consume(Token::TokenType::KW_begin))
+        return true;
+    // a block holds at least one assignment (SPrime in grammer.txt), so a
+    // loop body always stores and writes a value
+    if (Tok.is(Token::TokenType::KW_end))
     {
-        error();
-        goto _error2;
+        error("Expected statement before");
+        return true;
     }
-    go_ahead();
-    Grammer *condition = parseComp();
+    while (!Tok.isOneOf(Token::TokenType::KW_end, Token::TokenType::eoi))
+    {
+        AssignNode *a = parseAssign();
+        if (a)
+        {
+            Assigns.push_back(a);
+            continue;
+        }
+        // skip to the next assignment of the block; at the start of another
+        // statement the end is missing
+        while (!Tok.isOneOf(Token::TokenType::semicolon, Token::TokenType::KW_end, Token::TokenType::eoi,
+                            Token::TokenType::KW_int, Token::TokenType::KW_if, Token::TokenType::KW_loopc))
+            go_ahead();
+        if (Tok.is(Token::TokenType::semicolon))
+            go_ahead();
+        else if (!Tok.is(Token::TokenType::KW_end))
+            return true;
+    }
+    return consume(Token::TokenType::KW_end);
+}
+
+IfPartNode *Parser::parseifPart()
+{
     llvm::SmallVector<AssignNode *> assigns;
-    go_ahead();
-    if (!Tok.is(Token::TokenType::KW_begin))
+    ExprId condition;
+
+    if (!Tok.is(Token::TokenType::KW_if))
     {
         error();
         goto _error2;
     }
     go_ahead();
-    while (!Tok.is(Token::TokenType::KW_end))
-    {
-        assigns.push_back(parseAssign());
-    }
-    go_ahead();
-    Res = (Grammer *)new IfPartNode(condition, (llvm::SmallVector<AssignNode *>)assigns);
-    return Res;
+    condition = parseComp();
+    if (parseBody(assigns))
+        goto _error2;
+    return Ctx.create<IfPartNode>(condition, Ctx.copy(llvm::makeArrayRef(assigns)));
 _error2:
+    return nullptr;
 }
 
-Grammer *Parser::parseelifPart()
+ElifPartNode *Parser::parseelifPart()
 {
-    Grammer *Res = nullptr;
-    IfPartNode *theIfStateMent;
+    llvm::SmallVector<AssignNode *> assigns;
+    ExprId condition;
 
     if (!Tok.is(Token::TokenType::KW_elif))
     {
@@ -313,86 +453,71 @@ Grammer *Parser::parseelifPart()
         goto _error2;
     }
     go_ahead();
-    Grammer *condition = parseComp();
-    llvm::SmallVector<AssignNode *> assigns;
-    go_ahead();
-    if (!Tok.is(Token::TokenType::KW_begin))
-    {
-        error();
+    condition = parseComp();
+    if (parseBody(assigns))
         goto _error2;
-    }
-    go_ahead();
-    while (!Tok.is(Token::TokenType::KW_end))
-    {
-        assigns.push_back(parseAssign());
-    }
-    go_ahead();
-    Res = (Grammer *)new ElifPartNode(condition, (llvm::SmallVector<AssignNode *>)assigns);
-    return Res;
+    return Ctx.create<ElifPartNode>(condition, Ctx.copy(llvm::makeArrayRef(assigns)));
 _error2:
+    return nullptr;
 }
 
-Grammer *Parser::parseelsePart()
+ElsePartNode *Parser::parseelsePart()
 {
-    Grammer *Res = nullptr;
-    IfPartNode *theIfStateMent;
+    llvm::SmallVector<AssignNode *> assigns;
 
     if (!Tok.is(Token::TokenType::KW_else))
     {
         error();
         goto _error2;
     }
-    llvm::SmallVector<AssignNode *> assigns;
-    go_ahead();
     go_ahead();
-    if (!Tok.is(Token::TokenType::KW_begin))
-    {
-        error();
+    if (parseBody(assigns))
         goto _error2;
-    }
-    go_ahead();
-    while (!Tok.is(Token::TokenType::KW_end))
-    {
-        assigns.push_back(parseAssign());
-    }
-    go_ahead();
-    Res = (Grammer *)new ElsePartNode((llvm::SmallVector<AssignNode *>)assigns);
-    return Res;
+    return Ctx.create<ElsePartNode>(Ctx.copy(llvm::makeArrayRef(assigns)));
 _error2:
+    return nullptr;
 }
 
-Grammer *Parser::parseCondition()
+ConditionNode *Parser::parseCondition()
 {
-    Grammer *Res = nullptr;
-    IfPartNode *theIfStateMent;
-    llvm::SmallVector<ElifPartNode *> AssignNode;
-    ElsePartNode *theIfStateMent;
+    IfPartNode *ifPart;
+    llvm::SmallVector<ElifPartNode *> elifParts;
+    ElsePartNode *elsePart = nullptr;
 
-    if (!Tok.is(Token::TokenType::KW_if))
+    ifPart = parseifPart();
+    if (!ifPart)
+        return nullptr;
+    while (Tok.is(Token::TokenType::KW_elif))
     {
-        error();
-        goto _error2;
+        ElifPartNode *elifPart = parseelifPart();
+        if (!elifPart)
+            return nullptr;
+        elifParts.push_back(elifPart);
     }
-    go_ahead();
-    Grammer *condition = parseComp();
+    if (Tok.is(Token::TokenType::KW_else))
+    {
+        elsePart = parseelsePart();
+        if (!elsePart)
+            return nullptr;
+    }
+    return Ctx.create<ConditionNode>(ifPart, Ctx.copy(llvm::makeArrayRef(elifParts)), elsePart);
+}
+
+LoopNode *Parser::parseLoop()
+{
     llvm::SmallVector<AssignNode *> assigns;
-    go_ahead();
-    if (!Tok.is(Token::TokenType::KW_begin))
+    ExprId condition;
+
+    if (!Tok.is(Token::TokenType::KW_loopc))
     {
         error();
         goto _error2;
     }
     go_ahead();
-    while (!Tok.is(Token::TokenType::KW_end))
-    {
-        assigns.push_back(parseAssign());
-    }
-    go_ahead();
-    while (Tok.is(Token::TokenType::KW_elif))
-    {
-        assigns.push_back(parseelifPart());
-    }
-
-    return Res;
+    condition = parseComp();
+    if (parseBody(assigns))
+        goto _error2;
+    return Ctx.create<LoopNode>(condition, Ctx.copy(llvm::makeArrayRef(assigns)));
 _error2:
+    return nullptr;
 }
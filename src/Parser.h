@@ -2,24 +2,65 @@
 #define PARSER_H
 
 #include "AST.h"
+#include "ASTContext.h"
 #include "Lexer.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cassert>
 
 class Parser
 {
-    Lexer &Lex;    // retrieve the next token from the input
-    Token Tok;     // stores the next token
-    bool HasError; // indicates if an error was detected
+    Lexer *Lex;                 // retrieve the next token from the input, or
+    const TokenBuffer *Tokens;  // take them from the tokens lexed up front
+    size_t Index;               // position of the next token in Tokens
+    size_t Last;                // position of the final eoi in Tokens
+    ASTContext &Ctx;  // owns the memory of the created AST nodes
+    ExprPool &Exprs;  // stores the expressions of the AST
+    Token Tok;        // stores the next token
+    bool HasError;    // indicates if an error was detected
+    unsigned NumErrors; // number of syntax errors reported
 
-    void error()
+    // stacks of parseComp(), kept to reuse their memory
+    llvm::SmallVector<ExprId, 16> Operands;
+    llvm::SmallVector<Token::TokenType, 16> Operators; // pending operators and open parentheses
+
+    void error() { error("Unexpected"); }
+
+    // reports Message about the look-ahead
+    void error(const char *Message)
     {
-        llvm::errs() << "Unexpected: " << Tok.getText() << "\n";
+        llvm::errs() << Message << ": " << Tok.getText() << "\n";
         HasError = true;
+        ++NumErrors;
     }
 
     // retrieves the next token from the lexer.expect()
     // tests whether the look-ahead is of the expected kind
-    void go_ahead() { Lex.next(Tok); }
+    void go_ahead()
+    {
+        if (!Tokens)
+        {
+            Lex->next(Tok);
+            return;
+        }
+        Tok = Tokens->get(Index);
+        if (Index != Last) // stay on the final eoi
+            ++Index;
+    }
+
+    // returns the token N positions after the look-ahead without consuming it
+    Token peek(unsigned N = 1)
+    {
+        if (!Tokens)
+            return Lex->peek(N - 1);
+        return Tokens->get(std::min(Index + N - 1, Last));
+    }
+
+    // tests whether the token starts an assignment ("=" | "+=" | "-=" | "*=" | "/=" | "%=")
+    static bool isAssignOp(const Token &T)
+    {
+        return T.isOneOf(Token::equal, Token::add, Token::sub, Token::multi, Token::div, Token::left_over);
+    }
 
     bool expect(Token::TokenType Kind)
     {
@@ -40,24 +81,60 @@ class Parser
         return false;
     }
 
-    AST *parseGSM();
-    Expr *parseVar();
-    Expr *parseAssign();
-    Expr *parseExpr();
-    Expr *parseTerm();
-    Expr *parseFactor();
+    AST *parseATA();
+    Grammer *parseRecovering();
+    void synchronize();
+    DecNode *parseVar();
+    AssignNode *parseAssign();
+    ConditionNode *parseCondition();
+    IfPartNode *parseifPart();
+    ElifPartNode *parseelifPart();
+    ElsePartNode *parseelsePart();
+    LoopNode *parseLoop();
+    bool parseBody(llvm::SmallVectorImpl<AssignNode *> &Assigns);
+
+    // expressions are appended to the ExprPool of the context
+    ExprId parseComp();
+    ExprId parseFactor();
+    void reduce(unsigned MinPrecedence);
 
 public:
     // initializes all members and retrieves the first token
-    Parser(Lexer &Lex) : Lex(Lex), HasError(false)
+    Parser(Lexer &Lex, ASTContext &Ctx)
+        : Lex(&Lex), Tokens(nullptr), Index(0), Last(0), Ctx(Ctx), Exprs(Ctx.getExprs()), HasError(false),
+          NumErrors(0)
+    {
+        go_ahead();
+    }
+
+    // parses tokens lexed up front with Lexer::tokenizeAll, which must
+    // outlive the parser and end with eoi, so they are never empty
+    Parser(const TokenBuffer &Tokens, ASTContext &Ctx)
+        : Lex(nullptr), Tokens(&Tokens), Index(0), Last(Tokens.size() - 1), Ctx(Ctx), Exprs(Ctx.getExprs()),
+          HasError(false), NumErrors(0)
     {
+        assert(Tokens.size() && Tokens.getKind(Last) == Token::eoi && "tokens must end with eoi");
         go_ahead();
     }
 
     // get the value of error flag
     bool hasError() { return HasError; }
 
+    // Parses the whole input. After a syntax error the parser skips ahead
+    // to the next statement and goes on, so all syntax errors are reported
+    // in one pass; the tree then holds the statements that could be parsed.
     AST *parse();
+
+    // Parses a single top-level statement, for callers that keep the
+    // statements themselves. Returns null after a syntax error, the next
+    // call continues with the statement after it.
+    Grammer *parseStatement();
+
+    // tests whether the whole input has been parsed
+    bool atEnd() { return Tok.is(Token::eoi); }
+
+    // returns where the next token starts in the input
+    const char *getLocation() { return Tok.getText().data(); }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "PhaseReport.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include <sys/resource.h>
+
+using namespace llvm;
+
+// Returns the peak resident set size of the process in bytes. It only grows,
+// so the value at the end of a phase covers that phase and all before it.
+static uint64_t getPeakRSS()
+{
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage))
+    return 0;
+  return (uint64_t)Usage.ru_maxrss * 1024; // in kilobytes on Linux
+}
+
+PhaseReport::PhaseReport(StringRef Program)
+    : Program(Program.str()), Group("gsm", "GSM compilation phases")
+{
+}
+
+PhaseReport::~PhaseReport()
+{
+  // A timer group prints the timers it still holds when they are destroyed.
+  for (Phase &P : Phases)
+    P.T->clear();
+}
+
+PhaseReport::Phase &PhaseReport::get(StringRef Name)
+{
+  for (Phase &P : Phases)
+    if (P.T->getName() == Name)
+      return P;
+  Phases.emplace_back();
+  Phases.back().T = std::make_unique<Timer>(Name, Name, Group);
+  return Phases.back();
+}
+
+PhaseReport::Region::Region(PhaseReport *Report, StringRef Name)
+    : Report(Report), T(nullptr), Name(Name.str())
+{
+  if (!Report)
+    return;
+  T = Report->get(Name).T.get();
+  T->startTimer();
+}
+
+PhaseReport::Region::~Region()
+{
+  if (!Report)
+    return;
+  T->stopTimer();
+  Report->get(Name).PeakRSS = getPeakRSS();
+}
+
+double PhaseReport::getWallTime(StringRef Name) const
+{
+  for (const Phase &P : Phases)
+    if (P.T->getName() == Name)
+      return P.T->getTotalTime().getWallTime() * 1000;
+  return 0;
+}
+
+void PhaseReport::count(StringRef Name, StringRef Counter, uint64_t Value)
+{
+  auto &Counters = get(Name).Counters;
+  for (auto &C : Counters)
+    if (C.first == Counter)
+    {
+      C.second = Value;
+      return;
+    }
+  Counters.push_back({Counter.str(), Value});
+}
+
+void PhaseReport::print(raw_ostream &OS)
+{
+  OS << Program << ":\n";
+  OS << "  phase       wall ms    user ms     sys ms   peak RSS MB\n";
+  for (Phase &P : Phases)
+  {
+    TimeRecord Time = P.T->getTotalTime();
+    OS << format("  %-9s %9.3f  %9.3f  %9.3f  %12.1f", P.T->getName().c_str(), Time.getWallTime() * 1000,
+                 Time.getUserTime() * 1000, Time.getSystemTime() * 1000, P.PeakRSS / 1048576.0);
+    for (auto &C : P.Counters)
+      OS << "  " << C.first << "=" << C.second;
+    OS << "\n";
+  }
+}
+
+void PhaseReport::printJSON(raw_ostream &OS)
+{
+  json::OStream J(OS);
+  J.objectBegin();
+  J.attribute("program", Program);
+  J.attributeBegin("phases");
+  J.arrayBegin();
+  for (Phase &P : Phases)
+  {
+    TimeRecord Time = P.T->getTotalTime();
+    J.objectBegin();
+    J.attribute("name", P.T->getName());
+    J.attribute("wall_ms", Time.getWallTime() * 1000);
+    J.attribute("user_ms", Time.getUserTime() * 1000);
+    J.attribute("system_ms", Time.getSystemTime() * 1000);
+    J.attribute("peak_rss_bytes", P.PeakRSS);
+    for (auto &C : P.Counters)
+      J.attribute(C.first, C.second);
+    J.objectEnd();
+  }
+  J.arrayEnd();
+  J.attributeEnd();
+  J.objectEnd();
+  OS << "\n";
+}
@@ -0,0 +1,60 @@
+#ifndef PHASEREPORT_H
+#define PHASEREPORT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Collects the time, the memory and the counters of the phases of one
+// compilation for --time-report and --phase-stats. Every phase is timed by a Timer
+// of the TimerGroup of the report, in regions that may run several times.
+class PhaseReport
+{
+ struct Phase
+ {
+  std::unique_ptr<llvm::Timer> T;
+  uint64_t PeakRSS = 0; // bytes, when the phase last ended
+  std::vector<std::pair<std::string, uint64_t>> Counters;
+ };
+
+ std::string Program;
+ llvm::TimerGroup Group;
+ std::vector<Phase> Phases; // in the order they first ran
+
+ Phase &get(llvm::StringRef Name);
+
+public:
+ // Times a phase of a report from its construction to its destruction. A
+ // null report times nothing, so callers need not test for one.
+ class Region
+ {
+  PhaseReport *Report;
+  llvm::Timer *T;
+  std::string Name;
+
+ public:
+  Region(PhaseReport *Report, llvm::StringRef Name);
+  ~Region();
+ };
+
+ PhaseReport(llvm::StringRef Program);
+ ~PhaseReport();
+
+ // Returns the wall time of a phase in milliseconds, 0 if it did not run.
+ double getWallTime(llvm::StringRef Phase) const;
+
+ // Sets a counter of a phase, e.g. the number of tokens lexed.
+ void count(llvm::StringRef Phase, llvm::StringRef Counter, uint64_t Value);
+
+ // Prints one line per phase.
+ void print(llvm::raw_ostream &OS);
+
+ // Prints the report as a single line of JSON.
+ void printJSON(llvm::raw_ostream &OS);
+};
+
+#endif
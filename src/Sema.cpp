@@ -1,11 +1,25 @@
 #include "Sema.h"
-#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace {
 class InputCheck : public ASTVisitor {
-  llvm::StringSet<> Scope; // StringSet to store declared variables
+  llvm::BitVector Scope; // Declared variables, indexed by symbol
+  ExprPool *Exprs; // Flat expressions of the program
   bool HasError; // Flag to indicate if an error occurred
+  unsigned NumErrors; // Number of errors reported
+  // Tells if a name is declared by earlier statements that are not visited,
+  // when a single statement is checked
+  llvm::function_ref<bool(llvm::StringRef)> DeclaredBefore;
+
+  bool isDeclared(SymbolId Symbol, llvm::StringRef Name) {
+    return Scope.test(Symbol) || (DeclaredBefore && DeclaredBefore(Name));
+  }
+
+  void reportError() {
+    HasError = true;
+    ++NumErrors;
+  }
 
   enum ErrorType { Twice, Not }; // Enum to represent error types: Twice - variable declared twice, Not - variable not declared
 
@@ -14,88 +28,354 @@ class InputCheck : public ASTVisitor {
     llvm::errs() << "Variable " << V << " is "
                  << (ET == Twice ? "already" : "not")
                  << " declared\n";
-    HasError = true; // Set error flag to true
+    reportError(); // Set error flag to true
+  }
+
+  // Checks an expression. The subtree of E is the range [first(E), E] of the
+  // pool, so a linear scan visits every node without recursion.
+  void check(ExprId E) {
+    for (ExprId I = Exprs->first(E); I <= E; ++I) {
+      const Expr &Node = (*Exprs)[I];
+      if (Node.Kind == Expr::Ident) {
+        // Check if identifier is in the scope
+        if (!isDeclared(Exprs->getSymbol(I), Exprs->getName(I)))
+          error(Not, Exprs->getName(I));
+      } else if (Node.Kind == Expr::Div || Node.Kind == Expr::Mod) {
+        const Expr &Right = (*Exprs)[Node.RHS];
+        if (Right.Kind == Expr::Number && Right.getValue() == 0) {
+          llvm::errs() << "Division by zero is not allowed." << "\n";
+          reportError();
+        }
+      }
+    }
   }
 
 public:
-  InputCheck() : HasError(false) {} // Constructor
+  InputCheck() : Exprs(nullptr), HasError(false), NumErrors(0) {} // Constructor
+
+  // Constructor for checking single statements
+  InputCheck(ExprPool &Exprs, llvm::function_ref<bool(llvm::StringRef)> DeclaredBefore)
+      : Scope(Exprs.getNumSymbols()), Exprs(&Exprs), HasError(false), NumErrors(0),
+        DeclaredBefore(DeclaredBefore) {}
 
   bool hasError() { return HasError; } // Function to check if an error occurred
 
-  // Visit function for GSM nodes
-  virtual void visit(GSM &Node) override { 
-    for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+  unsigned getNumErrors() { return NumErrors; }
+
+  // Visit function for the root node
+  virtual void visit(GrammerNode &Node) override {
+    Exprs = &Node.getContext().getExprs();
+    Scope.resize(Exprs->getNumSymbols());
+    for (auto I = Node.statements.begin(), E = Node.statements.end(); I != E; ++I)
     {
       (*I)->accept(*this); // Visit each child node
     }
   };
 
-  // Visit function for Factor nodes
-  virtual void visit(Factor &Node) override {
-    if (Node.getKind() == Factor::Ident) {
-      // Check if identifier is in the scope
-      if (Scope.find(Node.getVal()) == Scope.end())
-        error(Not, Node.getVal());
+  // Visit function for Assignment nodes
+  virtual void visit(AssignNode &Node) override {
+    // Check if the identifier is in the scope
+    if (!isDeclared(Node.getSymbol(), Node.getIdentifier()))
+      error(Not, Node.getIdentifier());
+
+    check(Node.getExpr());
+
+    if (Node.getOp() == AssignNode::DIVIDE_EQUAL || Node.getOp() == AssignNode::MOD_EQUAL) {
+      const Expr &Right = (*Exprs)[Node.getExpr()];
+      if (Right.Kind == Expr::Number && Right.getValue() == 0) {
+        llvm::errs() << "Division by zero is not allowed." << "\n";
+        reportError();
+      }
     }
   };
 
-  // Visit function for BinaryOp nodes
-  virtual void visit(BinaryOp &Node) override {
-    if (Node.getLeft())
-      Node.getLeft()->accept(*this);
-    else
-      HasError = true;
+  virtual void visit(DecNode &Node) override {
+    for (size_t I = 0, E = Node.identifiers.size(); I != E; ++I) {
+      if (isDeclared(Node.symbols[I], Node.identifiers[I]))
+        error(Twice, Node.identifiers[I]); // Report a "Twice" error if the variable is already in the scope
+      Scope.set(Node.symbols[I]);
+    }
+    for (ExprId E : Node.expressions)
+      check(E); // Check the initial value of each variable
+  };
 
-    auto right = Node.getRight();
-    if (right)
-      right->accept(*this);
-    else
-      HasError = true;
+  virtual void visit(ConditionNode &Node) override {
+    Node.ifPart->accept(*this);
+    for (ElifPartNode *Elif : Node.elifParts)
+      Elif->accept(*this);
+    if (Node.elseParts)
+      Node.elseParts->accept(*this);
+  };
 
-    if (Node.getOperator() == BinaryOp::Operator::Div && right) {
-      Factor * f = (Factor *)right;
+  virtual void visit(IfPartNode &Node) override {
+    check(Node.condition);
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+  };
 
-      if (right && f->getKind() == Factor::ValueKind::Number) {
-        int intval;
-        f->getVal().getAsInteger(10, intval);
+  virtual void visit(ElifPartNode &Node) override {
+    check(Node.condition);
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+  };
 
-        if (intval == 0) {
-          llvm::errs() << "Division by zero is not allowed." << "\n";
-          HasError = true;
+  virtual void visit(ElsePartNode &Node) override {
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+  };
+
+  virtual void visit(LoopNode &Node) override {
+    check(Node.condition);
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+  };
+};
+
+// Folds constant expressions and propagates the values of variables through
+// the program. Known holds the variables whose value is known before the
+// statement being visited and Values their values, both indexed by symbol.
+class ConstantFolder : public ASTVisitor {
+  ExprPool *Exprs;
+  llvm::BitVector Known;
+  std::vector<int32_t> Values;
+  llvm::SmallVector<uint32_t, 32> Sizes; // live nodes in the subtree of each node
+  Sema::FoldStats &Stats;
+  unsigned Conditional; // Nesting of the parts being visited that may not run
+
+  // A division by a folded zero is left to the program, which may guard it,
+  // as in `if y != 0: begin x = 10 / y; end`. Only one that always runs is
+  // worth a warning.
+  void divisionByZero() {
+    llvm::errs() << "warning: division by zero\n";
+  }
+
+  // Tests if the node I of the subtree of E is in the right operand of an
+  // and or an or, which is not evaluated when the left one decides the
+  // result. The nodes after I are not folded yet, so their ranges are intact.
+  bool isShortCircuited(ExprId I, ExprId E) {
+    for (ExprId J = I + 1; J <= E; ++J) {
+      const Expr &Node = (*Exprs)[J];
+      if ((Node.Kind == Expr::And || Node.Kind == Expr::Or) && Exprs->first(Node.RHS) <= I && I <= Node.RHS)
+        return true;
+    }
+    return false;
+  }
+
+  // Computes L Kind R the way the generated code does, with 32-bit
+  // wrap-around. Returns false if the result is not defined.
+  static bool evaluate(Expr::ExprKind Kind, int32_t L, int32_t R, int32_t &Res) {
+    uint32_t UL = L, UR = R;
+    switch (Kind) {
+    case Expr::Plus: Res = (int32_t)(UL + UR); return true;
+    case Expr::Minus: Res = (int32_t)(UL - UR); return true;
+    case Expr::Mul: Res = (int32_t)(UL * UR); return true;
+    case Expr::Div:
+    case Expr::Mod:
+      if (R == 0 || (L == INT32_MIN && R == -1))
+        return false;
+      Res = Kind == Expr::Div ? L / R : L % R;
+      return true;
+    case Expr::Power: {
+      // 1 / L ^ -R, truncated toward zero, is 0 unless L is 1 or -1.
+      if (R < 0) {
+        Res = L == 1 ? 1 : L == -1 ? ((R & 1) ? -1 : 1) : 0;
+        return true;
+      }
+      uint32_t Result = 1;
+      for (; UR; UR >>= 1, UL *= UL)
+        if (UR & 1)
+          Result *= UL;
+      Res = (int32_t)Result;
+      return true;
+    }
+    case Expr::LessThan: Res = L < R; return true;
+    case Expr::GreaterThan: Res = L > R; return true;
+    case Expr::LessThanEqual: Res = L <= R; return true;
+    case Expr::GreaterThanEqual: Res = L >= R; return true;
+    case Expr::Equal: Res = L == R; return true;
+    case Expr::NotEqual: Res = L != R; return true;
+    case Expr::And: Res = L != 0 && R != 0; return true;
+    case Expr::Or: Res = L != 0 || R != 0; return true;
+    default: return false;
+    }
+  }
+
+  // Folds E in place: known variables become literals and every operation
+  // on two literals becomes a literal. The operands of a folded node stay in
+  // the pool but are no longer reachable, and the range [first(E), E] still
+  // covers all reachable nodes. Returns true if E is now a literal.
+  bool fold(ExprId E) {
+    ExprId First = Exprs->first(E);
+    Stats.Nodes += E - First + 1;
+    Sizes.resize(E - First + 1);
+    for (ExprId I = First; I <= E; ++I) {
+      Expr &Node = (*Exprs)[I];
+      uint32_t &Size = Sizes[I - First];
+      Size = 1;
+      if (Node.Kind == Expr::Ident) {
+        SymbolId Symbol = Exprs->getSymbol(I);
+        if (Known.test(Symbol)) {
+          Node = {Expr::Number, (uint32_t)Values[Symbol], 0};
+          ++Stats.Propagated;
         }
+        continue;
+      }
+      if (Node.isLeaf())
+        continue;
+      Size += Sizes[Node.LHS - First] + Sizes[Node.RHS - First];
+      const Expr &Left = (*Exprs)[Node.LHS], &Right = (*Exprs)[Node.RHS];
+      if (Left.Kind != Expr::Number || Right.Kind != Expr::Number)
+        continue;
+      if ((Node.Kind == Expr::Div || Node.Kind == Expr::Mod) && Right.getValue() == 0) {
+        if (!Conditional && !isShortCircuited(I, E))
+          divisionByZero();
+        continue;
+      }
+      int32_t Value;
+      if (evaluate(Node.Kind, Left.getValue(), Right.getValue(), Value)) {
+        Stats.Eliminated += Size - 1;
+        Size = 1;
+        Node = {Expr::Number, (uint32_t)Value, 0};
       }
     }
-  };
+    return (*Exprs)[E].Kind == Expr::Number;
+  }
 
-  // Visit function for Assignment nodes
-  virtual void visit(Assignment &Node) override {
-    Factor *dest = Node.getLeft();
+  // Forgets the variables the assignments may change.
+  void forget(llvm::ArrayRef<AssignNode *> Assigns) {
+    for (AssignNode *A : Assigns)
+      Known.reset(A->getSymbol());
+  }
 
-    dest->accept(*this);
+  void setKnown(SymbolId Symbol, int32_t Value) {
+    Known.set(Symbol);
+    Values[Symbol] = Value;
+  }
 
-    if (dest->getKind() == Factor::Number) {
-        llvm::errs() << "Assignment destination must be an identifier.";
-        HasError = true;
+  // The state of a variable before an if statement.
+  struct SavedState {
+    SymbolId Symbol;
+    bool Known;
+    int32_t Value;
+  };
+
+  void save(llvm::ArrayRef<AssignNode *> Assigns, llvm::SmallVectorImpl<SavedState> &Saved) {
+    for (AssignNode *A : Assigns)
+      Saved.push_back({A->getSymbol(), Known.test(A->getSymbol()), Values[A->getSymbol()]});
+  }
+
+  // Restores the variables to their state before the statement. A variable
+  // saved twice has the same state both times.
+  void restore(llvm::ArrayRef<SavedState> Saved) {
+    for (const SavedState &S : Saved) {
+      Known[S.Symbol] = S.Known;
+      Values[S.Symbol] = S.Value;
     }
+  }
+
+public:
+  ConstantFolder(Sema::FoldStats &Stats) : Exprs(nullptr), Stats(Stats), Conditional(0) {}
+
+  virtual void visit(GrammerNode &Node) override {
+    Exprs = &Node.getContext().getExprs();
+    Known.resize(Exprs->getNumSymbols());
+    Values.resize(Exprs->getNumSymbols());
+    for (Grammer *G : Node.statements)
+      G->accept(*this);
+  };
 
-    if (dest->getKind() == Factor::Ident) {
-      // Check if the identifier is in the scope
-      if (Scope.find(dest->getVal()) == Scope.end())
-        error(Not, dest->getVal());
+  virtual void visit(DecNode &Node) override {
+    // The variables are initialized one after the other.
+    for (size_t I = 0, E = Node.identifiers.size(); I != E; ++I) {
+      if (fold(Node.expressions[I]))
+        setKnown(Node.symbols[I], (*Exprs)[Node.expressions[I]].getValue());
+      else
+        Known.reset(Node.symbols[I]);
     }
+  };
 
-    if (Node.getRight())
-      Node.getRight()->accept(*this);
+  virtual void visit(AssignNode &Node) override {
+    bool Constant = fold(Node.getExpr());
+    Expr &Value = (*Exprs)[Node.getExpr()];
+    if (Constant && (Node.getOp() == AssignNode::DIVIDE_EQUAL || Node.getOp() == AssignNode::MOD_EQUAL) &&
+        Value.getValue() == 0 && !Conditional)
+      divisionByZero();
+    if (Constant && Node.getOp() != AssignNode::EQUAL) {
+      // A compound assignment to a known variable becomes a plain one.
+      static const Expr::ExprKind Ops[] = {Expr::Plus, Expr::Plus, Expr::Minus, Expr::Mul, Expr::Div, Expr::Mod};
+      SymbolId Symbol = Node.getSymbol();
+      int32_t Result;
+      if (Known.test(Symbol) && evaluate(Ops[Node.getOp()], Values[Symbol], Value.getValue(), Result)) {
+        Value = {Expr::Number, (uint32_t)Result, 0};
+        Node.setOp(AssignNode::EQUAL);
+      } else
+        Constant = false;
+    }
+    if (Constant)
+      setKnown(Node.getSymbol(), Value.getValue());
+    else
+      Known.reset(Node.getSymbol());
   };
 
-  virtual void visit(Declaration &Node) override {
-    for (auto I = Node.begin(), E = Node.end(); I != E;
-         ++I) {
-      if (!Scope.insert(*I).second)
-        error(Twice, *I); // If the insertion fails (element already exists in Scope), report a "Twice" error
+  virtual void visit(ConditionNode &Node) override {
+    // Every part starts from the values known before the statement; after
+    // it, the variables assigned in any part are unknown. The parts only
+    // hold assignments, so only the assigned variables are saved.
+    llvm::SmallVector<SavedState, 16> Before;
+    save(Node.ifPart->assigns, Before);
+    for (ElifPartNode *Elif : Node.elifParts)
+      save(Elif->assigns, Before);
+    if (Node.elseParts)
+      save(Node.elseParts->assigns, Before);
+    Node.ifPart->accept(*this);
+    for (ElifPartNode *Elif : Node.elifParts) {
+      restore(Before);
+      Elif->accept(*this);
     }
-    if (Node.getExpr())
-      Node.getExpr()->accept(*this); // If the Declaration node has an expression, recursively visit the expression node
+    if (Node.elseParts) {
+      restore(Before);
+      Node.elseParts->accept(*this);
+    }
+    forget(Node.ifPart->assigns);
+    for (ElifPartNode *Elif : Node.elifParts)
+      forget(Elif->assigns);
+    if (Node.elseParts)
+      forget(Node.elseParts->assigns);
+  };
+
+  virtual void visit(IfPartNode &Node) override {
+    // Only the first condition is always evaluated.
+    fold(Node.condition);
+    ++Conditional;
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+    --Conditional;
+  };
+
+  virtual void visit(ElifPartNode &Node) override {
+    ++Conditional;
+    fold(Node.condition);
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+    --Conditional;
+  };
+
+  virtual void visit(ElsePartNode &Node) override {
+    ++Conditional;
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+    --Conditional;
+  };
+
+  virtual void visit(LoopNode &Node) override {
+    // The condition and the body see the values of an arbitrary iteration.
+    forget(Node.assigns);
+    fold(Node.condition);
+    ++Conditional;
+    for (AssignNode *A : Node.assigns)
+      A->accept(*this);
+    --Conditional;
+    forget(Node.assigns);
   };
 };
 }
@@ -109,3 +389,18 @@ bool Sema::semantic(AST *Tree) {
 
   return Check.hasError(); // Return the result of Check.hasError() indicating if any errors were detected during the analysis
 }
+
+void Sema::fold(AST *Tree, FoldStats &Stats) {
+  if (!Tree)
+    return;
+
+  ConstantFolder Folder(Stats);
+  Tree->accept(Folder);
+}
+
+unsigned Sema::checkStatement(Grammer *Stmt, ExprPool &Exprs,
+                              llvm::function_ref<bool(llvm::StringRef)> DeclaredBefore) {
+  InputCheck Check(Exprs, DeclaredBefore);
+  Stmt->accept(Check);
+  return Check.getNumErrors();
+}
@@ -3,10 +3,31 @@
 
 #include "AST.h"
 #include "Lexer.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 
 class Sema {
 public:
+  // Counts of what fold() did.
+  struct FoldStats {
+    unsigned Nodes = 0;      // expression nodes before folding
+    unsigned Eliminated = 0; // expression nodes folded away
+    unsigned Propagated = 0; // uses of variables replaced by their value
+  };
+
   bool semantic(AST *Tree);
+
+  // Folds constant subexpressions in place and replaces the uses of
+  // variables whose value is known at that point by the value, so less code
+  // is generated. Runs after semantic() found no errors. A division by an
+  // operand that folds to zero is left as it is, with a warning if it is
+  // always executed.
+  void fold(AST *Tree, FoldStats &Stats);
+
+  // Checks one top-level statement of a program, reporting the same errors
+  // as semantic(). DeclaredBefore tells whether a name is declared by the
+  // statements in front of it. Returns the number of errors.
+  unsigned checkStatement(Grammer *Stmt, ExprPool &Exprs,
+                          llvm::function_ref<bool(llvm::StringRef)> DeclaredBefore);
 };
 
 #endif
\ No newline at end of file
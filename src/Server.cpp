@@ -0,0 +1,344 @@
+#include "Server.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Path.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace server;
+
+namespace
+{
+  // Requests larger than this are rejected without being read.
+  const uint32_t MaxSourceSize = 256 << 20;
+
+  // A program running longer than this many seconds is killed.
+  const unsigned RequestTimeout = 30;
+
+  // A client that sends or receives nothing for this many seconds is
+  // disconnected.
+  const unsigned ConnectionTimeout = 10;
+
+  // Connections beyond this many wait until one of them is finished.
+  const unsigned MaxConnections = 64;
+
+  // Reads or writes exactly Size bytes, retrying after signals and short
+  // transfers. Returns true on error or end of file.
+  bool readAll(int FD, void *Buf, size_t Size)
+  {
+    char *P = static_cast<char *>(Buf);
+    while (Size)
+    {
+      ssize_t N = ::read(FD, P, Size);
+      if (N < 0 && errno == EINTR)
+        continue;
+      if (N <= 0)
+        return true;
+      P += N;
+      Size -= N;
+    }
+    return false;
+  }
+
+  bool writeAll(int FD, const void *Buf, size_t Size)
+  {
+    const char *P = static_cast<const char *>(Buf);
+    while (Size)
+    {
+      ssize_t N = ::write(FD, P, Size);
+      if (N < 0 && errno == EINTR)
+        continue;
+      if (N <= 0)
+        return true;
+      P += N;
+      Size -= N;
+    }
+    return false;
+  }
+
+  // Reads the whole content of a file descriptor from its start.
+  std::string readFile(int FD)
+  {
+    std::string Data;
+    if (::lseek(FD, 0, SEEK_SET) < 0)
+      return Data;
+    char Buf[65536];
+    ssize_t N;
+    while ((N = ::read(FD, Buf, sizeof(Buf))) > 0 || (N < 0 && errno == EINTR))
+      if (N > 0)
+        Data.append(Buf, N);
+    return Data;
+  }
+
+  // Fills a sockaddr_un with Path. Returns true if the path is too long.
+  bool makeAddress(StringRef Path, sockaddr_un &Addr)
+  {
+    std::memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    if (Path.size() >= sizeof(Addr.sun_path))
+    {
+      errs() << "Socket path is too long: " << Path << "\n";
+      return true;
+    }
+    std::memcpy(Addr.sun_path, Path.data(), Path.size());
+    return false;
+  }
+
+  struct Response
+  {
+    bool Failed = true;
+    int Result = 0;
+    std::string Output;
+    std::string Diags;
+  };
+
+  // Compiles one program in a child process. The child writes the output and
+  // the diagnostics into two temporary files and reports the outcome through
+  // a pipe, so the server survives programs that crash or never finish.
+  Response compileInChild(StringRef Source, Action Act, unsigned OptLevel,
+                          CompileFn Compile)
+  {
+    Response Res;
+    FILE *Out = std::tmpfile(), *Diags = std::tmpfile();
+    int Status[2] = {-1, -1};
+    if (!Out || !Diags || ::pipe(Status))
+    {
+      Res.Diags = "Cannot create the output files of the compilation\n";
+      if (Out)
+        std::fclose(Out);
+      if (Diags)
+        std::fclose(Diags);
+      return Res;
+    }
+
+    pid_t Pid = ::fork();
+    if (Pid == 0)
+    {
+      // The child: redirect the standard streams and run the pipeline.
+      ::close(Status[0]);
+      int Null = ::open("/dev/null", O_RDONLY);
+      ::dup2(Null, 0);
+      ::dup2(fileno(Out), 1);
+      ::dup2(fileno(Diags), 2);
+      ::alarm(RequestTimeout);
+
+      std::unique_ptr<MemoryBuffer> Buffer =
+          MemoryBuffer::getMemBuffer(Source, "<request>", /*RequiresNullTerminator=*/false);
+      int Result = 0;
+      bool Failed = Compile(*Buffer, Act, OptLevel, Result);
+      outs().flush();
+      std::fflush(stdout);
+
+      char Msg[5];
+      Msg[0] = Failed;
+      support::endian::write32le(Msg + 1, Result);
+      writeAll(Status[1], Msg, sizeof(Msg));
+      ::_exit(0);
+    }
+    ::close(Status[1]);
+
+    if (Pid < 0)
+      Res.Diags = std::string("Cannot fork: ") + std::strerror(errno) + "\n";
+    else
+    {
+      char Msg[5];
+      bool Incomplete = readAll(Status[0], Msg, sizeof(Msg));
+      int WaitStatus = 0;
+      while (::waitpid(Pid, &WaitStatus, 0) < 0 && errno == EINTR)
+        ;
+      Res.Output = readFile(fileno(Out));
+      Res.Diags = readFile(fileno(Diags));
+      if (!Incomplete)
+      {
+        Res.Failed = Msg[0];
+        Res.Result = support::endian::read32le(Msg + 1);
+      }
+      else if (WIFSIGNALED(WaitStatus))
+        Res.Diags += "The compilation was terminated by signal " +
+                     std::to_string(WTERMSIG(WaitStatus)) + "\n";
+      else
+        Res.Diags += "The compilation exited early\n";
+    }
+    ::close(Status[0]);
+    std::fclose(Out);
+    std::fclose(Diags);
+    return Res;
+  }
+
+  // Reads one request from the connection and answers it.
+  void handle(int Conn, CompileFn Compile)
+  {
+    timeval Timeout = {ConnectionTimeout, 0};
+    ::setsockopt(Conn, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+    ::setsockopt(Conn, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+
+    char Header[6];
+    if (readAll(Conn, Header, sizeof(Header)))
+      return;
+    Action Act = static_cast<Action>(Header[0]);
+    unsigned OptLevel = static_cast<uint8_t>(Header[1]);
+    uint32_t Size = support::endian::read32le(Header + 2);
+
+    Response Res;
+    std::string Source;
+    if (Act > ActionRun || OptLevel > 3 || Size > MaxSourceSize)
+      Res.Diags = "Invalid request\n";
+    else
+    {
+      Source.resize(Size);
+      if (readAll(Conn, &Source[0], Size))
+        return;
+      Res = compileInChild(Source, Act, OptLevel, Compile);
+    }
+
+    char Reply[13];
+    Reply[0] = Res.Failed;
+    support::endian::write32le(Reply + 1, Res.Result);
+    support::endian::write32le(Reply + 5, Res.Output.size());
+    support::endian::write32le(Reply + 9, Res.Diags.size());
+    if (!writeAll(Conn, Reply, sizeof(Reply)) &&
+        !writeAll(Conn, Res.Output.data(), Res.Output.size()))
+      writeAll(Conn, Res.Diags.data(), Res.Diags.size());
+  }
+
+  // Only interrupts accept(), the server loop reaps the connections.
+  void onChildExit(int) {}
+}
+
+std::string server::getDefaultSocketPath()
+{
+  SmallString<128> Path;
+  sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Path);
+  sys::path::append(Path, "gsm-" + std::to_string(::getuid()) + ".sock");
+  return std::string(Path.str());
+}
+
+bool server::serve(StringRef SocketPath, CompileFn Compile)
+{
+  sockaddr_un Addr;
+  if (makeAddress(SocketPath, Addr))
+    return true;
+
+  int Sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Sock < 0)
+  {
+    errs() << "Cannot create socket: " << std::strerror(errno) << "\n";
+    return true;
+  }
+
+  // Replace the socket of a previous server that was killed.
+  ::unlink(Addr.sun_path);
+  if (::bind(Sock, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) ||
+      ::listen(Sock, SOMAXCONN))
+  {
+    errs() << "Cannot listen on " << SocketPath << ": " << std::strerror(errno) << "\n";
+    ::close(Sock);
+    return true;
+  }
+
+  // A client closing its connection early must not kill the server.
+  ::signal(SIGPIPE, SIG_IGN);
+  // Every connection is handled in a process of its own, so a slow client or
+  // program does not hold up the others. The exit of one interrupts
+  // accept(), without SA_RESTART, to reap it.
+  struct sigaction ChildExit = {};
+  ChildExit.sa_handler = onChildExit;
+  ::sigaction(SIGCHLD, &ChildExit, nullptr);
+  errs() << "gsm: serving on " << SocketPath << "\n";
+
+  unsigned Connections = 0;
+  while (true)
+  {
+    // Reap the finished connections, waiting for one while there are too many.
+    for (;;)
+    {
+      pid_t Done = ::waitpid(-1, nullptr, Connections < MaxConnections ? WNOHANG : 0);
+      if (Done > 0)
+        --Connections;
+      else if (Done == 0 || errno != EINTR)
+        break;
+    }
+
+    int Conn = ::accept(Sock, nullptr, nullptr);
+    if (Conn < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errs() << "Cannot accept connection: " << std::strerror(errno) << "\n";
+      break;
+    }
+    pid_t Pid = ::fork();
+    if (Pid == 0)
+    {
+      // compileInChild() waits for its own child.
+      ::signal(SIGCHLD, SIG_DFL);
+      ::close(Sock);
+      handle(Conn, Compile);
+      ::close(Conn);
+      ::_exit(0);
+    }
+    if (Pid < 0)
+      errs() << "Cannot fork: " << std::strerror(errno) << "\n";
+    else
+      ++Connections;
+    ::close(Conn);
+  }
+  ::close(Sock);
+  return true;
+}
+
+bool server::request(StringRef SocketPath, StringRef Source, Action Act,
+                     unsigned OptLevel, raw_ostream &Output, raw_ostream &Diags,
+                     int &Result)
+{
+  sockaddr_un Addr;
+  if (makeAddress(SocketPath, Addr))
+    return true;
+
+  int Sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Sock < 0 || ::connect(Sock, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)))
+  {
+    Diags << "Cannot connect to " << SocketPath << ": " << std::strerror(errno) << "\n";
+    if (Sock >= 0)
+      ::close(Sock);
+    return true;
+  }
+
+  char Header[6];
+  Header[0] = Act;
+  Header[1] = OptLevel;
+  support::endian::write32le(Header + 2, Source.size());
+
+  char Reply[13];
+  bool Failed = writeAll(Sock, Header, sizeof(Header)) ||
+                writeAll(Sock, Source.data(), Source.size()) ||
+                readAll(Sock, Reply, sizeof(Reply));
+  std::string Out, Diag;
+  if (!Failed)
+  {
+    Out.resize(support::endian::read32le(Reply + 5));
+    Diag.resize(support::endian::read32le(Reply + 9));
+    Failed = readAll(Sock, &Out[0], Out.size()) || readAll(Sock, &Diag[0], Diag.size());
+  }
+  ::close(Sock);
+  if (Failed)
+  {
+    Diags << "The connection to the server was lost\n";
+    return true;
+  }
+
+  Output << Out;
+  Diags << Diag;
+  Result = static_cast<int32_t>(support::endian::read32le(Reply + 1));
+  return Reply[0];
+}
@@ -0,0 +1,57 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <string>
+
+// A compile server for many small programs. It accepts programs on a Unix
+// domain socket and compiles each one with the normal pipeline in a process
+// forked from the warm server, so LLVM is initialized once and a crashing or
+// hanging program cannot take the server down. Each connection is handled by
+// a process of its own, so an idle client or a slow program does not block
+// the other clients.
+//
+// Every connection carries one request and one response, integers are little
+// endian:
+//   request:  u8 Action, u8 OptLevel, u32 Size, Size bytes of source text
+//   response: u8 Failed, i32 Result, u32 OutputSize, u32 DiagSize,
+//             OutputSize bytes of output, DiagSize bytes of diagnostics
+// The output is the IR, bitcode, assembly or object file, or for ActionRun
+// what the program printed; Result is the exit code of the program.
+namespace server
+{
+  enum Action : uint8_t
+  {
+    ActionLL,  // textual LLVM IR
+    ActionBC,  // LLVM bitcode
+    ActionAsm, // native assembly
+    ActionObj, // native object file
+    ActionRun  // execute with the JIT
+  };
+
+  // Compiles one program, writing the output to the standard output and the
+  // diagnostics to the standard error. Returns true if an error occurred.
+  typedef llvm::function_ref<bool(const llvm::MemoryBuffer &Source, Action Act,
+                                  unsigned OptLevel, int &Result)>
+      CompileFn;
+
+  // Returns the default socket path, private to the current user.
+  std::string getDefaultSocketPath();
+
+  // Serves requests on SocketPath until the process is killed. Returns true
+  // if the socket cannot be set up.
+  bool serve(llvm::StringRef SocketPath, CompileFn Compile);
+
+  // Sends a program to the server on SocketPath and writes the response to
+  // Output and Diags. Returns true if the server cannot be reached or the
+  // compilation failed; Result receives the exit code of the program.
+  bool request(llvm::StringRef SocketPath, llvm::StringRef Source, Action Act,
+               unsigned OptLevel, llvm::raw_ostream &Output,
+               llvm::raw_ostream &Diags, int &Result);
+}
+
+#endif
@@ -0,0 +1,327 @@
+#include "Session.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Sema.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+
+namespace
+{
+  // Collects the variables a statement declares and the ones it uses.
+  class NameCollector : public ASTVisitor
+  {
+    ExprPool &Exprs;
+
+    void collect(ExprId E)
+    {
+      for (ExprId I = Exprs.first(E); I <= E; ++I)
+        if (Exprs[I].Kind == Expr::Ident)
+          Uses.push_back(Exprs.getName(I));
+    }
+
+  public:
+    SmallVector<StringRef, 4> Decls;
+    SmallVector<StringRef, 8> Uses;
+
+    NameCollector(ExprPool &Exprs) : Exprs(Exprs) {}
+
+    virtual void visit(GrammerNode &) override {}
+
+    virtual void visit(DecNode &Node) override
+    {
+      Decls.append(Node.identifiers.begin(), Node.identifiers.end());
+      for (ExprId E : Node.expressions)
+        collect(E);
+    }
+
+    virtual void visit(AssignNode &Node) override
+    {
+      Uses.push_back(Node.getIdentifier());
+      collect(Node.getExpr());
+    }
+
+    virtual void visit(ConditionNode &Node) override
+    {
+      Node.ifPart->accept(*this);
+      for (ElifPartNode *Elif : Node.elifParts)
+        Elif->accept(*this);
+      if (Node.elseParts)
+        Node.elseParts->accept(*this);
+    }
+
+    virtual void visit(IfPartNode &Node) override
+    {
+      collect(Node.condition);
+      for (AssignNode *A : Node.assigns)
+        A->accept(*this);
+    }
+
+    virtual void visit(ElifPartNode &Node) override
+    {
+      collect(Node.condition);
+      for (AssignNode *A : Node.assigns)
+        A->accept(*this);
+    }
+
+    virtual void visit(ElsePartNode &Node) override
+    {
+      for (AssignNode *A : Node.assigns)
+        A->accept(*this);
+    }
+
+    virtual void visit(LoopNode &Node) override
+    {
+      collect(Node.condition);
+      for (AssignNode *A : Node.assigns)
+        A->accept(*this);
+    }
+  };
+
+  // Parses statements from Lex into Nodes, storing where each one ends.
+  // Returns true on a syntax error.
+  bool parseAll(Lexer &Lex, ASTContext &Ctx, StringRef Text,
+                SmallVectorImpl<std::pair<Grammer *, size_t>> &Nodes)
+  {
+    Parser Parse(Lex, Ctx);
+    while (!Parse.atEnd())
+    {
+      Grammer *Node = Parse.parseStatement();
+      if (!Node)
+        return true;
+      Nodes.push_back({Node, size_t(Parse.getLocation() - Text.data())});
+    }
+    return false;
+  }
+}
+
+// The AST is rebuilt once it is this much larger than after the last
+// compaction, so replaced statements use a bounded share of the memory.
+static const size_t CompactionSlack = 1 << 20;
+
+Session::Session() : CompactedSize(0), NumErrors(0) {}
+
+Session::~Session() = default;
+
+void Session::index(Statement *S, bool Add, StringSet<> &Affected)
+{
+  NameCollector Names(Ctx->getExprs());
+  S->Node->accept(Names);
+  for (StringRef Name : Names.Decls)
+  {
+    Affected.insert(Name);
+    if (Add)
+      Declarers[Name].insert(S);
+    else
+      Declarers[Name].erase(S);
+  }
+  for (StringRef Name : Names.Uses)
+  {
+    if (Add)
+      Users[Name].insert(S);
+    else
+      Users[Name].erase(S);
+  }
+}
+
+void Session::check(Statement *S)
+{
+  // A name is declared in front of S if one of its declarations is.
+  auto DeclaredBefore = [&](StringRef Name)
+  {
+    auto It = Declarers.find(Name);
+    if (It == Declarers.end())
+      return false;
+    for (Statement *D : It->second)
+      if (D->Index < S->Index)
+        return true;
+    return false;
+  };
+  NumErrors -= S->Errors;
+  S->Errors = Sema().checkStatement(S->Node, Ctx->getExprs(), DeclaredBefore);
+  NumErrors += S->Errors;
+  ++LastStats.Checked;
+}
+
+bool Session::generate()
+{
+  CG = std::make_unique<IncrementalCodeGen>();
+  BasicBlock *After = nullptr;
+  for (auto &S : Statements)
+  {
+    if (CG->insert(S->Node, Ctx->getExprs(), After, nullptr, S->Code))
+    {
+      CG.reset();
+      return true;
+    }
+    After = S->Code.Last;
+    ++LastStats.Generated;
+  }
+  return false;
+}
+
+void Session::compact()
+{
+  // The text is unchanged, so parsing it again yields the same statements.
+  // The symbols keep their numbers, the generated code refers to variables
+  // by them.
+  auto NewCtx = std::make_unique<ASTContext>();
+  ExprPool &Exprs = Ctx->getExprs();
+  for (size_t I = 0, E = Exprs.getNumSymbols(); I != E; ++I)
+    NewCtx->getExprs().intern(Exprs.getSymbolName(I));
+  Lexer Lex(Text);
+  SmallVector<std::pair<Grammer *, size_t>, 0> Nodes;
+  parseAll(Lex, *NewCtx, Text, Nodes);
+  assert(Nodes.size() == Statements.size() && "statements changed");
+  for (size_t I = 0, E = Statements.size(); I != E; ++I)
+    Statements[I]->Node = Nodes[I].first;
+  Ctx = std::move(NewCtx);
+  CompactedSize = Ctx->getBytesAllocated();
+  LastStats.Compacted = true;
+}
+
+bool Session::update(StringRef NewText)
+{
+  LastStats = Stats();
+  if (!Ctx)
+    Ctx = std::make_unique<ASTContext>();
+
+  // Find the edited range: the common prefix and suffix of both versions.
+  // Whole blocks are compared with memcmp first.
+  StringRef OldText = Text;
+  size_t Min = std::min(OldText.size(), NewText.size());
+  const size_t Block = 256;
+  size_t Prefix = 0;
+  while (Min - Prefix >= Block && !memcmp(OldText.data() + Prefix, NewText.data() + Prefix, Block))
+    Prefix += Block;
+  while (Prefix != Min && OldText[Prefix] == NewText[Prefix])
+    ++Prefix;
+  if (Prefix == OldText.size() && Prefix == NewText.size() && !Statements.empty())
+    return NumErrors != 0 || !CG;
+  size_t Suffix = 0;
+  while (Min - Prefix - Suffix >= Block &&
+         !memcmp(OldText.end() - Suffix - Block, NewText.end() - Suffix - Block, Block))
+    Suffix += Block;
+  while (Suffix != Min - Prefix &&
+         OldText[OldText.size() - 1 - Suffix] == NewText[NewText.size() - 1 - Suffix])
+    ++Suffix;
+  ptrdiff_t Delta = ptrdiff_t(NewText.size()) - ptrdiff_t(OldText.size());
+
+  // The first statement the edit touches. When the edit starts right at a
+  // statement, the last token of the one in front may continue into it,
+  // e.g. "end" becoming "endx", so that one is parsed again as well.
+  size_t First = std::partition_point(Statements.begin(), Statements.end(),
+                                      [&](const std::unique_ptr<Statement> &S)
+                                      { return S->End <= Prefix; }) -
+                 Statements.begin();
+  if (First != 0 && (First == Statements.size() || Statements[First]->Begin == Prefix))
+    --First;
+  size_t Begin = First != Statements.size() ? Statements[First]->Begin : 0;
+
+  // Parse until a statement ends in the unchanged suffix where an old
+  // statement begins; from there on the old statements are still valid.
+  Lexer Lex(NewText.drop_front(Begin));
+  Parser Parse(Lex, *Ctx);
+  std::vector<std::unique_ptr<Statement>> New;
+  size_t Last = Statements.size();
+  size_t Pos = Begin;
+  while (!Parse.atEnd())
+  {
+    Grammer *Node = Parse.parseStatement();
+    if (!Node)
+      return true;
+    size_t End = Parse.getLocation() - NewText.data();
+    New.push_back(std::unique_ptr<Statement>(new Statement{Node, Pos, End, 0, 0, {}}));
+    Pos = End;
+    if (End >= NewText.size() - Suffix && End != NewText.size())
+    {
+      size_t OldEnd = End - Delta;
+      auto It = std::partition_point(Statements.begin() + First, Statements.end(),
+                                     [&](const std::unique_ptr<Statement> &S)
+                                     { return S->Begin < OldEnd; });
+      if (It != Statements.end() && (*It)->Begin == OldEnd)
+      {
+        Last = It - Statements.begin();
+        break;
+      }
+    }
+  }
+  LastStats.Parsed = New.size();
+  LastStats.Removed = Last - First;
+
+  // Replace the old statements [First, Last) with the new ones.
+  StringSet<> Affected;
+  for (size_t I = First; I != Last; ++I)
+  {
+    Statement *S = Statements[I].get();
+    index(S, false, Affected);
+    NumErrors -= S->Errors;
+    if (CG)
+      CG->erase(S->Code, First ? Statements[First - 1]->Code.Last : nullptr,
+                I + 1 != Statements.size() ? Statements[I + 1]->Code.First : nullptr);
+  }
+  size_t NumNew = New.size();
+  Statements.erase(Statements.begin() + First, Statements.begin() + Last);
+  Statements.insert(Statements.begin() + First, std::make_move_iterator(New.begin()),
+                    std::make_move_iterator(New.end()));
+  for (size_t I = First, E = Statements.size(); I != E; ++I)
+  {
+    Statements[I]->Index = I;
+    if (I >= First + NumNew)
+    {
+      Statements[I]->Begin += Delta;
+      Statements[I]->End += Delta;
+    }
+  }
+  Text = NewText.str();
+
+  // Check the new statements, and the ones declaring or using a name that
+  // was declared or is declared now by the edited statements.
+  SmallPtrSet<Statement *, 16> ToCheck;
+  for (size_t I = First; I != First + NumNew; ++I)
+  {
+    index(Statements[I].get(), true, Affected);
+    ToCheck.insert(Statements[I].get());
+  }
+  for (auto &Name : Affected)
+  {
+    auto D = Declarers.find(Name.getKey());
+    if (D != Declarers.end())
+      ToCheck.insert(D->second.begin(), D->second.end());
+    auto U = Users.find(Name.getKey());
+    if (U != Users.end())
+      ToCheck.insert(U->second.begin(), U->second.end());
+  }
+  // Report the errors in program order.
+  SmallVector<Statement *, 16> Order(ToCheck.begin(), ToCheck.end());
+  llvm::sort(Order, [](Statement *A, Statement *B) { return A->Index < B->Index; });
+  for (Statement *S : Order)
+    check(S);
+
+  if (Ctx->getBytesAllocated() > 2 * CompactedSize + CompactionSlack)
+    compact();
+
+  // The IR is kept only while the program is free of errors.
+  if (NumErrors)
+  {
+    CG.reset();
+    return true;
+  }
+  if (!CG)
+    return generate();
+  BasicBlock *After = First ? Statements[First - 1]->Code.Last : nullptr;
+  BasicBlock *Before = First + NumNew != Statements.size() ? Statements[First + NumNew]->Code.First : nullptr;
+  for (size_t I = First; I != First + NumNew; ++I)
+  {
+    Statement *S = Statements[I].get();
+    if (CG->insert(S->Node, Ctx->getExprs(), After, Before, S->Code))
+    {
+      CG.reset();
+      return true;
+    }
+    After = S->Code.Last;
+    ++LastStats.Generated;
+  }
+  return false;
+}
@@ -0,0 +1,82 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "AST.h"
+#include "ASTContext.h"
+#include "CodeGen.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Module.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Keeps a program between compilations for editors that resubmit the whole
+// file after every change. A GSM program is a flat list of top-level
+// statements; an update re-lexes and re-parses only the statements the edit
+// touches, checks again only the statements declaring or using the names
+// they declare, and regenerates the IR of the new statements while the rest
+// of the module is kept.
+class Session
+{
+public:
+  // What the last update() did.
+  struct Stats
+  {
+    unsigned Parsed = 0;    // statements parsed
+    unsigned Removed = 0;   // statements replaced by the parsed ones
+    unsigned Checked = 0;   // statements checked by Sema
+    unsigned Generated = 0; // statements the IR was generated for
+    bool Compacted = false; // the AST was rebuilt to release old nodes
+  };
+
+private:
+  struct Statement
+  {
+    Grammer *Node;
+    size_t Begin, End; // the ranges of all statements tile the text
+    unsigned Index;    // position in Statements
+    unsigned Errors;   // number of errors found by Sema
+    IncrementalCodeGen::Range Code;
+  };
+
+  std::string Text;
+  std::unique_ptr<ASTContext> Ctx; // owns the AST, including replaced statements
+  size_t CompactedSize;            // bytes in Ctx after the last compaction
+  std::vector<std::unique_ptr<Statement>> Statements;
+
+  // The statements declaring and using each variable.
+  llvm::StringMap<llvm::SmallPtrSet<Statement *, 2>> Declarers;
+  llvm::StringMap<llvm::SmallPtrSet<Statement *, 2>> Users;
+
+  unsigned NumErrors;                     // semantic errors of all statements
+  std::unique_ptr<IncrementalCodeGen> CG; // null while the IR is not up to date
+  Stats LastStats;
+
+  // Adds S to or removes it from Declarers and Users. The names S declares
+  // are added to Affected.
+  void index(Statement *S, bool Add, llvm::StringSet<> &Affected);
+  void check(Statement *S);
+  bool generate();
+  void compact();
+
+public:
+  Session();
+  ~Session();
+
+  // Replaces the program with NewText. Returns true if the new version has
+  // errors; after a syntax error the previous version is kept.
+  bool update(llvm::StringRef NewText);
+
+  // Returns the unoptimized module of the program, or null if it has errors.
+  // The module is updated in place by the next update().
+  llvm::Module *getModule() { return CG ? &CG->getModule() : nullptr; }
+
+  const Stats &getStats() const { return LastStats; }
+
+  size_t getNumStatements() const { return Statements.size(); }
+};
+
+#endif